@@ -0,0 +1,330 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pool.h"
+#include "sys.h"
+
+/**
+ * nes_batch.c
+ *
+ * Runs a list of jobs, each a ROM with an optional input movie for a number
+ * of frames, on a work-stealing thread pool with one system per job. Prints
+ * the hash of the final frame and the time taken by every job.
+ *
+ * Every line of the job file is
+ *
+ *   <rom path> <movie path or -> <frames>
+ *
+ * Empty lines and lines starting with # are skipped. Movies use the FCEUX
+ * FM2 format; only the input log is read, one line per frame:
+ *
+ *   |<commands>|<port 0>|<port 1>|<port 2>|
+ *
+ * where ports 0 and 1 are 8 characters (RLDUTSBA, any character other than
+ * . or a space means pressed). Commands 1 (soft reset) and 2 (power) both
+ * reset the system. Frames after the end of the movie have no input.
+ *
+ * With -k, only every nth frame and the last one are drawn. The others still
+ * run with exact timing, so the final hash is the same.
+ */
+
+#define BATCH_PATH_SIZE 1024
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+#define MOVIE_RESET 0x3
+
+typedef enum {
+  JS_OK,
+  JS_ROM_ERROR,
+  JS_MOVIE_ERROR,
+  JS_STOPPED  // The system stopped before running all frames
+} job_status_t;
+
+static const char* JOB_STATUS_NAMES[] = {"ok", "rom-error", "movie-error",
+                                         "stopped"};
+
+/**
+ * The input for a single frame of a movie.
+ */
+typedef struct {
+  uint8_t commands;
+  controller_pressed_t pressed1;
+  controller_pressed_t pressed2;
+} movie_frame_t;
+
+typedef struct {
+  movie_frame_t* frames;
+  uint32_t length;
+} movie_t;
+
+typedef struct {
+  // Description
+  char rom[BATCH_PATH_SIZE];
+  char movie[BATCH_PATH_SIZE];  // Empty if none
+  uint32_t frames;
+  uint32_t render_every;
+
+  // Results
+  job_status_t status;
+  uint32_t worker;
+  uint32_t frames_run;
+  uint64_t screen_hash;
+  double ms;
+} job_t;
+
+/**
+ * Private functions
+ *
+ * batch_time
+ *   Returns a monotonic time, in milliseconds.
+ *
+ * movie_pressed
+ *   Parses the buttons of one port in an FM2 input log line.
+ *
+ * movie_load
+ *   Reads the input log of an FM2 movie.
+ *
+ * job_run
+ *   Pool task, runs a single job.
+ *
+ * jobs_load
+ *   Reads the job file.
+ */
+static double batch_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+static controller_pressed_t movie_pressed(const char* port) {
+  controller_pressed_t pressed = {0};
+  bool buttons[8] = {false};
+  for (int i = 0; i < 8 && port[i] != '\0' && port[i] != '|'; i++) {
+    buttons[i] = port[i] != '.' && port[i] != ' ';
+  }
+  pressed.right = buttons[0];
+  pressed.left = buttons[1];
+  pressed.down = buttons[2];
+  pressed.up = buttons[3];
+  pressed.start = buttons[4];
+  pressed.select = buttons[5];
+  pressed.b = buttons[6];
+  pressed.a = buttons[7];
+  return pressed;
+}
+
+static bool movie_load(movie_t* movie, const char* path) {
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    return false;
+  }
+  uint32_t capacity = 1024;
+  movie->frames = malloc(sizeof(movie_frame_t) * capacity);
+  movie->length = 0;
+
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] != '|') {
+      continue;  // Header
+    }
+    char* port0 = strchr(line + 1, '|');
+    char* port1 = port0 != NULL ? strchr(port0 + 1, '|') : NULL;
+    if (port1 == NULL) {
+      free(movie->frames);
+      fclose(fp);
+      return false;
+    }
+    if (movie->length == capacity) {
+      capacity *= 2;
+      movie->frames = realloc(movie->frames, sizeof(movie_frame_t) * capacity);
+    }
+    movie_frame_t* frame = movie->frames + movie->length++;
+    frame->commands = strtoul(line + 1, NULL, 10);
+    frame->pressed1 = movie_pressed(port0 + 1);
+    frame->pressed2 = movie_pressed(port1 + 1);
+  }
+  fclose(fp);
+  return true;
+}
+
+static void job_run(void* arg, uint32_t worker) {
+  job_t* job = (job_t*)arg;
+  double start = batch_time();
+  job->worker = worker;
+
+  movie_t movie = {.frames = NULL, .length = 0};
+  if (job->movie[0] != '\0' && !movie_load(&movie, job->movie)) {
+    job->status = JS_MOVIE_ERROR;
+    job->ms = batch_time() - start;
+    return;
+  }
+
+  sys_t* sys = sys_init();
+  if (sys_rom(sys, job->rom) != SS_NONE) {
+    job->status = JS_ROM_ERROR;
+  } else {
+    sys_start(sys);
+    sys_audio(sys, NULL, NULL, NULL);
+    job->status = JS_OK;
+    while (job->frames_run < job->frames) {
+      if (job->frames_run < movie.length) {
+        movie_frame_t* frame = movie.frames + job->frames_run;
+        if (frame->commands & MOVIE_RESET) {
+          sys_stop(sys);
+          sys_start(sys);
+        }
+        sys->controller->pressed1 = frame->pressed1;
+        sys->controller->pressed2 = frame->pressed2;
+      } else {
+        controller_clear(sys->controller);
+      }
+      sys->ppu->render = (job->frames_run + 1) % job->render_every == 0 ||
+                         job->frames_run + 1 == job->frames;
+      if (sys_run_frame(sys)) {
+        job->status = JS_STOPPED;
+        break;
+      }
+      job->frames_run++;
+    }
+    job->screen_hash = FNV_OFFSET;
+    const ppu_frame_t* frame = ppu_frame_acquire(sys->ppu);
+    for (size_t i = 0; i < sizeof(frame->screen); i++) {
+      job->screen_hash = (job->screen_hash ^ frame->screen[i]) * FNV_PRIME;
+    }
+  }
+  sys_deinit(sys);
+  free(movie.frames);
+  job->ms = batch_time() - start;
+}
+
+static job_t* jobs_load(FILE* fp, uint32_t* count) {
+  uint32_t capacity = 64;
+  job_t* jobs = malloc(sizeof(job_t) * capacity);
+  *count = 0;
+
+  char line[BATCH_PATH_SIZE * 2 + 64];
+  uint32_t line_number = 0;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    line_number++;
+    char* start = line + strspn(line, " \t");
+    if (*start == '#' || *start == '\n' || *start == '\0') {
+      continue;
+    }
+    if (*count == capacity) {
+      capacity *= 2;
+      jobs = realloc(jobs, sizeof(job_t) * capacity);
+    }
+    job_t* job = jobs + *count;
+    memset(job, 0, sizeof(job_t));
+    if (sscanf(start, "%1023s %1023s %u", job->rom, job->movie,
+               &job->frames) != 3) {
+      fprintf(stderr, "invalid job on line %u\n", line_number);
+      free(jobs);
+      return NULL;
+    }
+    if (!strcmp(job->movie, "-")) {
+      job->movie[0] = '\0';
+    }
+    (*count)++;
+  }
+  return jobs;
+}
+
+int main(int argc, char** argv) {
+  uint32_t threads = 0;
+  uint32_t render_every = 1;
+  int arg = 1;
+  while (arg + 1 < argc) {
+    if (!strcmp(argv[arg], "-j")) {
+      threads = strtoul(argv[arg + 1], NULL, 10);
+    } else if (!strcmp(argv[arg], "-k")) {
+      render_every = strtoul(argv[arg + 1], NULL, 10);
+    } else {
+      break;
+    }
+    arg += 2;
+  }
+  if (arg >= argc || render_every == 0 || !strcmp(argv[arg], "-h") ||
+      !strcmp(argv[arg], "--help")) {
+    printf("usage:\n");
+    printf("  build/nes_batch [-j threads] [-k n] <job file>\n");
+    printf("    - runs the jobs in the file (- for stdin), one per line:\n");
+    printf("      <rom path> <FM2 movie path or -> <frames>\n");
+    printf("    - uses one thread per CPU unless -j is given\n");
+    printf("    - -k only draws every nth frame and the last one\n");
+    return arg >= argc || render_every == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  FILE* fp = !strcmp(argv[arg], "-") ? stdin : fopen(argv[arg], "r");
+  if (fp == NULL) {
+    fprintf(stderr, "cannot read job file\n");
+    return EXIT_FAILURE;
+  }
+  uint32_t count;
+  job_t* jobs = jobs_load(fp, &count);
+  if (fp != stdin) {
+    fclose(fp);
+  }
+  if (jobs == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  double start = batch_time();
+  pool_t* pool = pool_init(threads);
+  for (uint32_t i = 0; i < count; i++) {
+    jobs[i].render_every = render_every;
+    pool_submit(pool, &job_run, jobs + i);
+  }
+  pool_wait(pool);
+  double ms = batch_time() - start;
+
+  // Results are printed in the order of the job file
+  bool failed = false;
+  uint64_t frames = 0;
+  printf("job\tstatus\tworker\tframes\tscreen\tms\trom\n");
+  for (uint32_t i = 0; i < count; i++) {
+    job_t* job = jobs + i;
+    printf("%u\t%s\t%u\t%u\t%016llx\t%.1f\t%s\n", i,
+           JOB_STATUS_NAMES[job->status], job->worker, job->frames_run,
+           (unsigned long long)job->screen_hash, job->ms, job->rom);
+    failed |= job->status != JS_OK;
+    frames += job->frames_run;
+  }
+  printf("# jobs: %u, workers: %u, steals: %u\n", count, pool->num_workers,
+         pool->steals);
+  printf("# time: %.1f ms, fps: %.1f\n", ms, ms > 0 ? frames * 1000 / ms : 0);
+
+  pool_deinit(pool);
+  free(jobs);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,235 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/**
+ * pool.c
+ */
+
+#define POOL_QUEUE_CAPACITY 16
+
+/**
+ * Private functions
+ *
+ * pool_queue_push
+ *   Adds a task at the tail of a queue, growing it if needed.
+ *
+ * pool_queue_pop
+ *   Takes the task at the tail of a queue (the owner's end).
+ *
+ * pool_queue_steal
+ *   Takes the task at the head of a queue (the thieves' end).
+ *
+ * pool_take
+ *   Takes a task for the given worker, from its own queue or by stealing.
+ *
+ * pool_worker_run
+ *   Thread entry point of a worker.
+ */
+static void pool_queue_push(pool_queue_t* queue, pool_task_t task) {
+  pthread_mutex_lock(&queue->lock);
+  if (queue->tail == queue->capacity) {
+    // Move the tasks to the start, and grow if more than half full
+    size_t size = queue->tail - queue->head;
+    if (size * 2 >= queue->capacity) {
+      queue->capacity *= 2;
+    }
+    pool_task_t* tasks = malloc(sizeof(pool_task_t) * queue->capacity);
+    for (size_t i = 0; i < size; i++) {
+      tasks[i] = queue->tasks[queue->head + i];
+    }
+    free(queue->tasks);
+    queue->tasks = tasks;
+    queue->head = 0;
+    queue->tail = size;
+  }
+  queue->tasks[queue->tail++] = task;
+  pthread_mutex_unlock(&queue->lock);
+}
+
+static bool pool_queue_pop(pool_queue_t* queue, pool_task_t* task) {
+  bool found = false;
+  pthread_mutex_lock(&queue->lock);
+  if (queue->tail > queue->head) {
+    *task = queue->tasks[--queue->tail];
+    found = true;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+static bool pool_queue_steal(pool_queue_t* queue, pool_task_t* task) {
+  bool found = false;
+  pthread_mutex_lock(&queue->lock);
+  if (queue->tail > queue->head) {
+    *task = queue->tasks[queue->head++];
+    found = true;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+static bool pool_take(pool_t* pool, uint32_t worker, pool_task_t* task) {
+  if (pool_queue_pop(pool->queues + worker, task)) {
+    return true;
+  }
+  for (uint32_t i = 1; i < pool->num_workers; i++) {
+    uint32_t victim = (worker + i) % pool->num_workers;
+    if (pool_queue_steal(pool->queues + victim, task)) {
+      pthread_mutex_lock(&pool->lock);
+      pool->steals++;
+      pthread_mutex_unlock(&pool->lock);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void* pool_worker_run(void* arg) {
+  pool_worker_t* worker = (pool_worker_t*)arg;
+  pool_t* pool = worker->pool;
+  while (true) {
+    pool_task_t task;
+    if (pool_take(pool, worker->index, &task)) {
+      pthread_mutex_lock(&pool->lock);
+      pool->queued--;
+      pthread_mutex_unlock(&pool->lock);
+
+      task.fn(task.arg, worker->index);
+
+      pthread_mutex_lock(&pool->lock);
+      pool->pending--;
+      if (pool->pending == 0) {
+        pthread_cond_broadcast(&pool->done);
+      }
+      pthread_mutex_unlock(&pool->lock);
+      continue;
+    }
+
+    // Sleep until there is something to take. Tasks are pushed before being
+    // counted in queued, so no wakeup can be missed.
+    pthread_mutex_lock(&pool->lock);
+    while (pool->queued == 0 && !pool->stopping) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    bool stopping = pool->stopping && pool->queued == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (stopping) {
+      return NULL;
+    }
+  }
+}
+
+/**
+ * Public functions
+ */
+pool_t* pool_init(uint32_t num_workers) {
+  if (num_workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = cpus > 0 ? cpus : 1;
+  }
+
+  pool_t* pool = malloc(sizeof(pool_t));
+  pool->num_workers = num_workers;
+  pool->workers = malloc(sizeof(pool_worker_t) * num_workers);
+  pool->queues = malloc(sizeof(pool_queue_t) * num_workers);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->queued = 0;
+  pool->pending = 0;
+  pool->next_queue = 0;
+  pool->stopping = false;
+  pool->steals = 0;
+
+  for (uint32_t i = 0; i < num_workers; i++) {
+    pool_queue_t* queue = pool->queues + i;
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->capacity = POOL_QUEUE_CAPACITY;
+    queue->tasks = malloc(sizeof(pool_task_t) * queue->capacity);
+    queue->head = 0;
+    queue->tail = 0;
+  }
+  for (uint32_t i = 0; i < num_workers; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i;
+    pthread_create(&pool->workers[i].thread, NULL, &pool_worker_run,
+                   pool->workers + i);
+  }
+  return pool;
+}
+
+void pool_submit(pool_t* pool, pool_fn_t fn, void* arg) {
+  pthread_mutex_lock(&pool->lock);
+  uint32_t queue = pool->next_queue;
+  pool->next_queue = (queue + 1) % pool->num_workers;
+  pool->pending++;
+  pthread_mutex_unlock(&pool->lock);
+
+  pool_task_t task = {.fn = fn, .arg = arg};
+  pool_queue_push(pool->queues + queue, task);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->queued++;
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait(pool_t* pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_deinit(pool_t* pool) {
+  pool_wait(pool);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (uint32_t i = 0; i < pool->num_workers; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+
+  for (uint32_t i = 0; i < pool->num_workers; i++) {
+    pthread_mutex_destroy(&pool->queues[i].lock);
+    free(pool->queues[i].tasks);
+  }
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->queues);
+  free(pool->workers);
+  free(pool);
+}
@@ -0,0 +1,105 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * pool.h
+ *
+ * A work-stealing thread pool. Every worker has its own queue of tasks: it
+ * takes the most recently added task from its own queue, and when that is
+ * empty, steals the oldest task from the queue of another worker.
+ */
+
+typedef void (*pool_fn_t)(void* arg, uint32_t worker);
+
+typedef struct {
+  pool_fn_t fn;
+  void* arg;
+} pool_task_t;
+
+/**
+ * The queue of a single worker. The owner works at the tail, thieves at the
+ * head.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  pool_task_t* tasks;
+  size_t capacity;
+  size_t head;
+  size_t tail;
+} pool_queue_t;
+
+struct pool;
+
+typedef struct {
+  struct pool* pool;
+  uint32_t index;
+  pthread_t thread;
+} pool_worker_t;
+
+typedef struct pool {
+  uint32_t num_workers;
+  pool_worker_t* workers;
+  pool_queue_t* queues;
+
+  // Protected by lock
+  pthread_mutex_t lock;
+  pthread_cond_t work;  // Signalled when tasks are queued or when stopping
+  pthread_cond_t done;  // Signalled when no tasks are left
+  uint32_t queued;      // Tasks in the queues
+  uint32_t pending;     // Tasks submitted and not yet finished
+  uint32_t next_queue;  // Queue for the next task submitted
+  bool stopping;
+
+  // Statistics
+  uint32_t steals;
+} pool_t;
+
+/**
+ * Starts a pool with the given number of workers, or one per online CPU if 0.
+ */
+pool_t* pool_init(uint32_t num_workers);
+
+/**
+ * Queues a task. The tasks are spread over the queues of the workers in turn.
+ * The function gets the argument and the index of the worker running it.
+ */
+void pool_submit(pool_t* pool, pool_fn_t fn, void* arg);
+
+/**
+ * Waits until all submitted tasks have finished.
+ */
+void pool_wait(pool_t* pool);
+
+/**
+ * Waits for all tasks, stops the workers and frees the pool.
+ */
+void pool_deinit(pool_t* pool);
@@ -0,0 +1,177 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apu.h"
+#include "blip.h"
+#include "event.h"
+#include "region.h"
+
+/**
+ * audio_bench.c
+ *
+ * Measures the cost of the audio output, in ns per output sample, with every
+ * resampler preset, output rate and sample format. The resampler is first
+ * timed alone, fed with a change every few clocks, then with the APU playing a
+ * busy tune on its pulse, triangle and noise channels, which includes running
+ * the APU itself.
+ */
+
+#define DEFAULT_SECONDS 60
+
+// Clocks between the changes fed to the resampler alone, about as often as
+// the output of the tune changes
+#define CHANGE_CLOCKS 16
+
+static const uint32_t RATES[] = {22050, 44100, 48000};
+static const char* QUALITIES[] = {"low", "medium", "high"};
+static const char* FORMATS[] = {"f32", "s16"};
+
+/**
+ * Private functions
+ *
+ * count_samples
+ *   APU callback, counts the samples enqueued.
+ *
+ * clock_rate
+ *   Returns the APU cycles per second of the given region.
+ *
+ * run_blip
+ *   Runs the resampler alone for a number of seconds, with kernels of the
+ *   given width, and returns the time taken per output sample in ns.
+ *
+ * play_tune
+ *   Sets up the channels of the APU to play a tune until stopped.
+ *
+ * run_apu
+ *   Plays the tune for a number of seconds with the given output, on an NTSC
+ *   APU, and returns the time taken per output sample in ns.
+ */
+static void count_samples(void* context, const void* samples, int len) {
+  *(uint64_t*)context += len;
+}
+
+static double clock_rate(const region_timing_t* timing) {
+  return (double)timing->master_hz_numerator /
+         ((double)timing->master_hz_denominator * timing->apu_divider);
+}
+
+static double run_blip(uint32_t rate, uint32_t width, uint32_t seconds) {
+  region_timing_t timing = region_timing(R_NTSC);
+  double cycles_second = clock_rate(&timing);
+  blip_t* blip = blip_init(cycles_second, rate, width);
+  float buffer[BLIP_MAX_SAMPLES];
+  float delta = 0.25f;
+  uint64_t samples = 0;
+  clock_t start = clock();
+  for (uint32_t i = 0; i < seconds * cycles_second / APU_BLIP_CYCLES; i++) {
+    for (uint32_t time = 0; time < APU_BLIP_CYCLES; time += CHANGE_CLOCKS) {
+      blip_add_delta(blip, time, delta);
+      delta = -delta;
+    }
+    blip_end_frame(blip, APU_BLIP_CYCLES);
+    samples += blip_read_samples(blip, buffer, BLIP_MAX_SAMPLES);
+  }
+  double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  blip_deinit(blip);
+  return samples > 0 ? elapsed * 1e9 / samples : 0.0;
+}
+
+static void play_tune(apu_t* apu) {
+  static const uint16_t writes[][2] = {
+      {0x4017, 0x40}, {0x4015, 0x0F},                  // No IRQ, channels on
+      {0x4000, 0xBF}, {0x4002, 0xFD}, {0x4003, 0x08},  // Pulse 1, A4
+      {0x4004, 0xBF}, {0x4006, 0x7D}, {0x4007, 0x09},  // Pulse 2, E5
+      {0x4008, 0xFF}, {0x400A, 0x80}, {0x400B, 0x08},  // Triangle, A3
+      {0x400C, 0x3F}, {0x400E, 0x04}, {0x400F, 0x08}   // Noise
+  };
+  for (size_t i = 0; i < sizeof(writes) / sizeof(writes[0]); i++) {
+    apu_mem_write(apu, writes[i][0], writes[i][1]);
+  }
+}
+
+static double run_apu(const apu_output_t* output, uint32_t seconds) {
+  region_timing_t timing = region_timing(R_NTSC);
+  uint32_t frame_cycles = clock_rate(&timing) / 60;
+  event_queue_t* events = event_init();
+  apu_t* apu = apu_init(events, timing.master_hz_numerator,
+                        timing.master_hz_denominator, timing.apu_divider);
+  apu_configure_output(apu, output);
+  play_tune(apu);
+
+  uint64_t samples = 0;
+  clock_t start = clock();
+  for (uint32_t i = 0; i < seconds * 60; i++) {
+    apu_run(apu, frame_cycles, &samples, &count_samples, NULL);
+  }
+  double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  apu_deinit(apu);
+  event_deinit(events);
+  return samples > 0 ? elapsed * 1e9 / samples : 0.0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))) {
+    printf("usage:\n");
+    printf("  build/audio_bench [seconds]\n");
+    printf("    - plays a tune on the APU for the given number of seconds\n");
+    printf("      (default %d) with every output, and reports the time per\n",
+           DEFAULT_SECONDS);
+    printf("      output sample\n");
+    return EXIT_SUCCESS;
+  }
+  uint32_t seconds = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_SECONDS;
+
+  printf("resampler alone\n");
+  printf("quality  rate   ns/sample\n");
+  for (int quality = AQ_LOW; quality <= AQ_HIGH; quality++) {
+    for (size_t rate = 0; rate < sizeof(RATES) / sizeof(RATES[0]); rate++) {
+      printf("%-8s %-6u %.2f\n", QUALITIES[quality], RATES[rate],
+             run_blip(RATES[rate],
+                      apu_quality_width((apu_quality_t)quality), seconds));
+    }
+  }
+
+  printf("\nAPU and resampler\n");
+  printf("quality  rate   format  ns/sample\n");
+  for (int quality = AQ_LOW; quality <= AQ_HIGH; quality++) {
+    for (size_t rate = 0; rate < sizeof(RATES) / sizeof(RATES[0]); rate++) {
+      for (int format = AF_F32; format <= AF_S16; format++) {
+        apu_output_t output = {.rate = RATES[rate],
+                               .format = (apu_format_t)format,
+                               .quality = (apu_quality_t)quality};
+        printf("%-8s %-6u %-7s %.2f\n", QUALITIES[quality], RATES[rate],
+               FORMATS[format], run_apu(&output, seconds));
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
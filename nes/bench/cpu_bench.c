@@ -0,0 +1,88 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "sys.h"
+
+/**
+ * cpu_bench.c
+ *
+ * Measures the speed of the CPU core alone, running a ROM without the PPU and
+ * the APU. The same source is built once per dispatch engine (cpu_bench uses
+ * the block cache, cpu_bench_threaded the threaded dispatch and
+ * cpu_bench_baseline the function pointer path that decodes every
+ * instruction), so running all three on the same ROM compares the engines.
+ */
+
+#define DEFAULT_CYCLES 50000000
+
+int main(int argc, char** argv) {
+  if (argc < 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+    printf("usage:\n");
+    printf("  build/cpu_bench <rom path> [cycles]\n");
+    printf("    - runs the CPU for the given number of cycles (default %d)\n",
+           DEFAULT_CYCLES);
+    return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  uint32_t cycles = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_CYCLES;
+
+  sys_t* sys = sys_init();
+  if (sys_rom(sys, argv[1]) != SS_NONE) {
+    fprintf(stderr, "cannot load ROM file\n");
+    sys_deinit(sys);
+    return EXIT_FAILURE;
+  }
+  sys_start(sys);
+
+  // Nothing is scheduled, the CPU only stops after the given cycles
+  uint64_t cycle = 0;
+  const uint64_t deadline = UINT64_MAX;
+  uint64_t executed = sys->cpu->instructions;
+  clock_t start = clock();
+  cpu_run(sys->cpu, &cycle, cycles, &deadline);
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  uint32_t instructions = sys->cpu->instructions - executed;
+
+#if defined(THREADED_DISPATCH)
+  printf("dispatch:     threaded\n");
+#elif defined(NO_BLOCK_CACHE)
+  printf("dispatch:     function pointer\n");
+#else
+  printf("dispatch:     block cache\n");
+#endif
+  printf("cycles:       %u\n", cycles);
+  printf("instructions: %u\n", instructions);
+  printf("time:         %.3f s\n", seconds);
+  printf("ns/instr:     %.2f\n", seconds * 1e9 / instructions);
+  printf("pc:           0x%04x\n", sys->cpu->program_counter);
+
+  sys_deinit(sys);
+  return EXIT_SUCCESS;
+}
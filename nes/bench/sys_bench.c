@@ -0,0 +1,180 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sys.h"
+
+/**
+ * sys_bench.c
+ *
+ * Runs many systems concurrently, one thread each, on the same ROM. Every
+ * system must end up in exactly the same state, which checks that no state is
+ * shared between systems. Also reports the combined speed, to see how many
+ * systems can be packed into a single process.
+ */
+
+#define DEFAULT_INSTANCES 64
+#define DEFAULT_FRAMES 600
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+/**
+ * One system running on its own thread.
+ */
+typedef struct {
+  pthread_t thread;
+  const char* path;
+  uint32_t frames;
+
+  // Results
+  bool loaded;
+  uint32_t frames_run;
+  uint64_t screen_hash;
+  uint64_t ram_hash;
+  uint64_t audio_hash;
+} instance_t;
+
+/**
+ * Private functions
+ *
+ * hash
+ *   Continues a FNV-1a hash with the given bytes.
+ *
+ * instance_audio
+ *   APU callback, hashes the samples of an instance.
+ *
+ * instance_run
+ *   Thread entry point, runs one system and records its results.
+ */
+static uint64_t hash(uint64_t h, const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ bytes[i]) * FNV_PRIME;
+  }
+  return h;
+}
+
+static void instance_audio(void* context, const void* samples, int len) {
+  instance_t* instance = (instance_t*)context;
+  // In the default output format, AF_F32
+  instance->audio_hash =
+      hash(instance->audio_hash, samples, len * sizeof(apu_buffer_t));
+}
+
+static void* instance_run(void* arg) {
+  instance_t* instance = (instance_t*)arg;
+  sys_t* sys = sys_init();
+  instance->loaded = sys_rom(sys, (char*)instance->path) == SS_NONE;
+  if (instance->loaded) {
+    sys_start(sys);
+    sys_audio(sys, instance, &instance_audio, NULL);
+    while (instance->frames_run < instance->frames && !sys_run_frame(sys)) {
+      instance->frames_run++;
+    }
+    const ppu_frame_t* frame = ppu_frame_acquire(sys->ppu);
+    instance->screen_hash =
+        hash(FNV_OFFSET, frame->screen, sizeof(frame->screen));
+    instance->ram_hash =
+        hash(FNV_OFFSET, sys->mapper->memory->ram, WORK_RAM_SIZE);
+  }
+  sys_deinit(sys);
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+    printf("usage:\n");
+    printf("  build/sys_bench <rom path> [instances] [frames]\n");
+    printf("    - runs the given number of systems (default %d) on separate\n",
+           DEFAULT_INSTANCES);
+    printf("      threads for a number of frames (default %d), and checks\n",
+           DEFAULT_FRAMES);
+    printf("      that they all end in the same state\n");
+    return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  uint32_t count = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_INSTANCES;
+  uint32_t frames = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_FRAMES;
+  if (count == 0) {
+    fprintf(stderr, "at least one instance is required\n");
+    return EXIT_FAILURE;
+  }
+
+  instance_t* instances = calloc(count, sizeof(instance_t));
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint32_t i = 0; i < count; i++) {
+    instances[i].path = argv[1];
+    instances[i].frames = frames;
+    instances[i].audio_hash = FNV_OFFSET;
+    if (pthread_create(&instances[i].thread, NULL, &instance_run,
+                       instances + i) != 0) {
+      fprintf(stderr, "cannot create thread %u\n", i);
+      return EXIT_FAILURE;
+    }
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    pthread_join(instances[i].thread, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  // Compare every instance against the first one
+  instance_t* first = instances;
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    instance_t* instance = instances + i;
+    if (!instance->loaded) {
+      fprintf(stderr, "cannot load ROM file\n");
+      free(instances);
+      return EXIT_FAILURE;
+    }
+    if (instance->frames_run != first->frames_run ||
+        instance->screen_hash != first->screen_hash ||
+        instance->ram_hash != first->ram_hash ||
+        instance->audio_hash != first->audio_hash) {
+      fprintf(stderr, "instance %u differs from instance 0\n", i);
+      mismatches++;
+    }
+  }
+
+  printf("instances: %u\n", count);
+  printf("frames:    %u\n", first->frames_run);
+  printf("screen:    %016llx\n", (unsigned long long)first->screen_hash);
+  printf("ram:       %016llx\n", (unsigned long long)first->ram_hash);
+  printf("audio:     %016llx\n", (unsigned long long)first->audio_hash);
+  printf("time:      %.3f s\n", seconds);
+  printf("fps:       %.1f\n", count * first->frames_run / seconds);
+  printf("result:    %s\n", mismatches == 0 ? "identical" : "MISMATCH");
+
+  free(instances);
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -31,15 +31,58 @@
 
 #include "apu_channels.h"
 #include "apu_typedefs.h"
+#include "blip.h"
+#include "event.h"
 #include "rom.h"
 
-#define APU_SAMPLE_RATE (21470000 / 12.0)
 #define APU_ACTUAL_SAMPLE_RATE 44100
 #define AUDIO_BUFFER_SIZE 512
 
+// Full scale of signed 16 bit samples
+#define APU_S16_SCALE 32767.0f
+
+// Rate control: most the output rate is nudged by, as a fraction, and weight
+// of every new reading in the average fill of the audio queue
+#define APU_RATE_CONTROL 0.005
+#define APU_RATE_SMOOTHING 0.125
+
+// Cycles after which synthesised samples are read into the buffer
+#define APU_BLIP_CYCLES 4096
+
 #define LU_PULSE_SIZE 31
 #define LU_TND_SIZE 203
 
+/**
+ * Formats of the output samples, mono in host byte order.
+ */
+typedef enum {
+  AF_F32,  // float, around -1 to 1
+  AF_S16   // int16_t
+} apu_format_t;
+
+/**
+ * Presets of the resampler, by the width of its kernels. Wider kernels filter
+ * out more of the aliasing, at a cost proportional to the number of changes
+ * of the output.
+ */
+typedef enum {
+  AQ_LOW,     // For slow machines like the Raspberry Pi
+  AQ_MEDIUM,  // The default
+  AQ_HIGH     // For capturing audio
+} apu_quality_t;
+
+/**
+ * Output of the APU, see apu_configure_output.
+ */
+typedef struct {
+  uint32_t rate;  // Samples per second, e.g. 22050, 44100 or 48000
+  apu_format_t format;
+  apu_quality_t quality;
+  // Samples to keep in the audio queue with rate control, or 0 for none. See
+  // apu_get_queue_size_t.
+  uint32_t queue_target;
+} apu_output_t;
+
 // Register bitfields
 typedef union {
   struct __attribute__((packed)) {
@@ -186,10 +229,23 @@ typedef union {
 typedef struct apu {
   mapper_t* mapper;
 
-  // Outputting sound
-  double sample_skips;
+  // Scheduling
+  event_queue_t* events;
+  uint32_t divider;   // Master clock cycles per APU cycle
+  uint64_t cycles;    // Cycles run since power on
+  double clock_rate;  // Cycles per second
+
+  // Outputting sound, synthesised from the changes of the mixer output
+  apu_output_t config;
+  blip_t* blip;
+  uint32_t blip_time;  // Cycles since the start of the blip frame
+  apu_buffer_t output;  // Mixer output, as last added to blip
   apu_buffer_t buffer[AUDIO_BUFFER_SIZE];
+  int16_t buffer_s16[AUDIO_BUFFER_SIZE];  // The buffer converted for AF_S16
   int buffer_cursor;
+  // Rate control, see apu_output_t
+  double queue_fill;   // Average samples in the audio queue
+  double rate_adjust;  // Fraction the output rate is currently nudged by
   bool is_even_cycle;
 
   // Channels
@@ -209,6 +265,10 @@ typedef struct apu {
 
     bool reset_queued;
     uint8_t reset_queue_divider;
+
+    // Cycle in which the frame counter does more than count, also scheduled
+    // as EV_APU_FRAME
+    uint64_t event;
   } frame_counter;
 
   double lookup_pulse_table[LU_PULSE_SIZE];
@@ -217,9 +277,35 @@ typedef struct apu {
 
 /**
  * Initialise the APU struct, setting all fields
- * to their default values
+ * to their default values. The frame counter schedules its events on the
+ * given queue, with the given master clock divider. The master clock runs at
+ * master_hz_numerator / master_hz_denominator Hz, see region_timing_t.
  */
-apu_t* apu_init(void);
+apu_t* apu_init(event_queue_t* events, uint64_t master_hz_numerator,
+                uint64_t master_hz_denominator, uint32_t divider);
+
+/**
+ * Changes the rate, format and resampler quality of the output, dropping the
+ * samples not yet enqueued. Defaults to 44100 Hz, AF_F32 and AQ_MEDIUM,
+ * without rate control. Returns false, keeping the previous output, if the
+ * buffer cannot be allocated.
+ *
+ * With rate control, the output rate is nudged by up to APU_RATE_CONTROL
+ * every time samples are enqueued, to bring the audio queue towards its
+ * target. This makes up for the drift between the emulation and the audio
+ * device.
+ */
+bool apu_configure_output(apu_t* apu, const apu_output_t* config);
+
+/**
+ * Returns the width of the resampler kernels of the given preset.
+ */
+uint32_t apu_quality_width(apu_quality_t quality);
+
+/**
+ * Returns the size in bytes of a sample in the given format.
+ */
+uint32_t apu_sample_size(apu_format_t format);
 
 /**
  * Memory acces utility functions
@@ -232,3 +318,11 @@ uint8_t apu_mem_read(apu_t* apu, uint16_t address);
  */
 void apu_cycle(apu_t* apu, void* context, apu_enqueue_audio_t enqueue_audio,
                apu_get_queue_size_t get_queue_size);
+void apu_run(apu_t* apu, uint32_t cycles, void* context,
+             apu_enqueue_audio_t enqueue_audio,
+             apu_get_queue_size_t get_queue_size);
+
+/**
+ * Frees any dynamic memory allocated for the APU.
+ */
+void apu_deinit(apu_t* apu);
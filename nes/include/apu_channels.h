@@ -71,9 +71,14 @@ typedef struct {
 } apu_channel_dmc_t;
 
 void apu_channel_pulse_sequencer_clock(apu_timer_context_t* context);
+void apu_channel_pulse_sequencer_skip(apu_channel_pulse_t* channel,
+                                      uint32_t steps);
 
 void apu_channel_triangle_sequencer_clock(apu_timer_context_t* context);
+void apu_channel_triangle_sequencer_skip(apu_channel_triangle_t* channel,
+                                         uint32_t steps);
 
 void apu_channel_triangle_linear_counter_clock(apu_channel_triangle_t* channel);
 
 void apu_channel_noise_lfsr_clock(apu_timer_context_t* context);
+void apu_channel_noise_lfsr_skip(apu_channel_noise_t* channel, uint32_t steps);
@@ -75,8 +75,12 @@ void apu_unit_sweep_clock(apu_unit_sweep_t* unit, bool ones_complement);
 typedef void apu_timer_context_t;
 typedef void (*apu_timer_clock_t)(apu_timer_context_t* context);
 
-void apu_unit_timer_clock(apu_unit_timer_t* unit, apu_timer_context_t* context,
+// Returns whether the divider reached 0 and on_clock was called
+bool apu_unit_timer_clock(apu_unit_timer_t* unit, apu_timer_context_t* context,
                           apu_timer_clock_t on_clock);
+// Clocks the timer many times at once, without calling back. Returns the
+// number of times the divider reached 0.
+uint32_t apu_unit_timer_skip(apu_unit_timer_t* unit, uint32_t clocks);
 
 void apu_unit_length_counter_reload(apu_unit_length_counter_t* unit);
 
@@ -0,0 +1,113 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * blip.h
+ *
+ * Band-limited synthesis of a waveform from its steps, in the style of
+ * blip_buf. Instead of being sampled, the waveform is described by the times
+ * (in input clocks) and sizes of its changes. Every change adds a band-limited
+ * step to a buffer of output samples, and reading integrates the buffer. This
+ * avoids aliasing, and costs nothing while the waveform holds its level.
+ *
+ * The steps come from a polyphase FIR filter: a bank of kernels, one per
+ * sub-sample position, of which every change uses the nearest. Wider kernels
+ * cut off more sharply, at a cost per change proportional to the width.
+ */
+
+// Sub-sample positions of a step
+#define BLIP_PHASE_BITS 6
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+
+// Most output samples spanned by a step. Widths must be multiples of 8, and
+// steps are delayed by about half of the width.
+#define BLIP_MAX_WIDTH 32
+
+// Output samples that can be pending at once
+#define BLIP_MAX_SAMPLES 1024
+
+// Bits of the fractional part of times in output samples
+#define BLIP_FRAC_BITS 32
+
+typedef struct {
+  uint64_t factor;  // Output samples per input clock, fixed point
+  uint64_t offset;  // Time of the frame start in output samples, fixed point
+  float integrator;
+  float bass;  // Leak of the integrator per output sample
+  uint32_t width;
+  float kernel[BLIP_PHASES][BLIP_MAX_WIDTH];  // Each phase sums to 1
+  float buffer[BLIP_MAX_SAMPLES + BLIP_MAX_WIDTH];  // Changes of the output
+} blip_t;
+
+/**
+ * Allocates a buffer converting the given input clock rate to the given
+ * output sample rate, with steps of the given width. It starts at a level of
+ * 0.
+ */
+blip_t* blip_init(double clock_rate, double sample_rate, uint32_t width);
+
+/**
+ * Changes the rates, keeping the samples pending.
+ */
+void blip_set_rates(blip_t* blip, double clock_rate, double sample_rate);
+
+/**
+ * Adds a change of the level, the given number of input clocks after the
+ * start of the current frame.
+ */
+void blip_add_delta(blip_t* blip, uint32_t time, float delta);
+
+/**
+ * Ends the current frame after the given number of input clocks, which makes
+ * the samples before its end available. There must be room for them, see
+ * blip_clocks_max.
+ */
+void blip_end_frame(blip_t* blip, uint32_t time);
+
+/**
+ * Returns the most input clocks that a frame can last, with no samples read.
+ */
+uint32_t blip_clocks_max(blip_t* blip);
+
+/**
+ * Returns the number of samples that can be read.
+ */
+uint32_t blip_samples_avail(blip_t* blip);
+
+/**
+ * Reads up to count samples, as many as are available. Returns the number
+ * read. The output passes through a gentle high-pass filter at 14 Hz, whatever
+ * the output rate, removing the DC offset.
+ */
+uint32_t blip_read_samples(blip_t* blip, float* out, uint32_t count);
+
+/**
+ * Frees the buffer.
+ */
+void blip_deinit(blip_t* blip);
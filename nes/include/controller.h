@@ -42,6 +42,13 @@
 #define NUM_CONTROLLER_DRIVERS 1
 #endif
 
+// Index of the SDL driver in CONTROLLER_DRIVERS
+#ifdef IS_PI
+#define CONTROLLER_DRIVER_SDL 1
+#else
+#define CONTROLLER_DRIVER_SDL 0
+#endif
+
 /**
  * This struct keeps track of which buttons are currently being pressed on
  * a controller.
@@ -84,6 +91,9 @@ typedef struct controller {
   controller_pressed_t pressed1;
   controller_status_t status2;
   controller_pressed_t pressed2;
+
+  // State of each of the CONTROLLER_DRIVERS, owned by the driver
+  void* drivers[NUM_CONTROLLER_DRIVERS];
 } controller_t;
 
 /**
@@ -92,23 +102,25 @@ typedef struct controller {
  */
 typedef struct {
   /**
-   * Initialises the controller driver.
+   * Initialises an instance of the controller driver, storing its state in
+   * data. The state is passed to the other functions, and is set even if the
+   * initialisation fails.
    *
    * Returns EC_SUCCESS in the case of success and EC_FAILURE if the driver
    * coundn't be initalised. Common causes of failure are lack of root access
    * (for the GPIO driver).
    */
-  int (*init)(void);
+  int (*init)(void** data);
 
   /**
    * Poll the driver and update the data in the struct.
    */
-  void (*poll)(controller_t* ctrl);
+  void (*poll)(void* data, controller_t* ctrl);
 
   /**
-   * Deinitialise the controller driver.
+   * Deinitialise the controller driver, freeing its state.
    */
-  void (*deinit)(void);
+  void (*deinit)(void* data);
 } controller_driver_t;
 
 /**
@@ -34,6 +34,6 @@
  * via the Raspberry Pi's GPIO pins.
  */
 
-int controller_nes_init(void);
-void controller_nes_poll(controller_t* ctrl);
-void controller_nes_deinit(void);
+int controller_nes_init(void** data);
+void controller_nes_poll(void* data, controller_t* ctrl);
+void controller_nes_deinit(void* data);
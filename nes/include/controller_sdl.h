@@ -25,7 +25,9 @@
 
 #pragma once
 
+#ifndef HEADLESS
 #include <SDL.h>
+#endif
 
 #include "controller.h"
 
@@ -33,10 +35,13 @@
  * controller_sdl.h
  *
  * The SDL controller driver. The SDL front forwards key down and key up
- * events via controller_sdl_button.
+ * events to the controller of its system via controller_sdl_button. In
+ * headless builds, the driver is kept but never reports any pressed buttons.
  */
 
-void controller_sdl_button(SDL_Event event);
-int controller_sdl_init(void);
-void controller_sdl_poll(controller_t* ctrl);
-void controller_sdl_deinit(void);
+#ifndef HEADLESS
+void controller_sdl_button(controller_t* ctrl, SDL_Event event);
+#endif
+int controller_sdl_init(void** data);
+void controller_sdl_poll(void* data, controller_t* ctrl);
+void controller_sdl_deinit(void* data);
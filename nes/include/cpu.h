@@ -42,6 +42,8 @@
 #define STACK_DEFAULT 0xFF
 #define STATUS_DEFAULT 0x20
 #define NUM_INSTRUCTIONS 0x100
+#define JIT_BLOCK_SIZE 32
+#define JIT_PAGES 0x100
 
 /**
  * The CPU status code, used to indicate errors.
@@ -51,6 +53,7 @@ typedef enum { CS_NONE, CS_UNSUPPORTED_INSTRUCTION } cpu_status_t;
 typedef enum { INTRT_NONE, INTRT_IRQ, INTRT_NMI, INTRT_RESET } interrupt_type_t;
 
 struct jit_instruction;
+struct jit_block;
 
 /*
  * Based on specification(s) from:
@@ -93,7 +96,11 @@ typedef struct cpu {
   mapper_t* mapper;
   uint8_t* memory;
 
-  struct jit_instruction* compiled;
+  struct jit_block** blocks;  // Blocks in writable memory, by address
+  struct jit_block* block;  // Block currently being executed
+  uint16_t block_pc;        // Address of the next instruction in the block
+  uint8_t block_index;
+  bool jit_pages[JIT_PAGES];  // Pages containing decoded writable memory
 
   // Misc
   bool branch_taken;
@@ -103,19 +110,38 @@ typedef struct cpu {
   uint8_t last_opcode;
   uint32_t busy;
   interrupt_type_t last_interrupt;
+  uint64_t instructions;  // Executed since power on
 } cpu_t;
 
 /**
  * JIT (Just-In-Time) compilation structs
+ *
+ * Instructions are decoded lazily, the first time their address is executed,
+ * into jit_instruction_t, with the effective address resolved whenever it
+ * does not depend on the CPU state. Runs of decoded instructions up to the
+ * next change of control flow are stored as threaded code in a jit_block_t,
+ * keyed by the entry PC and the host memory (i.e. the PRG bank) it was
+ * decoded from. Blocks decoded from RAM are invalidated when the CPU writes to
+ * the same page, and blocks decoded from ROM are cached per bank on the
+ * mapper, so they survive resets and bank switches.
  */
 typedef struct jit_instruction {
-  bool compiled;
   void (*execute)(cpu_t*, uint16_t);
-  uint16_t address;
+  uint16_t address;  // Effective address, or the operand if indexed
+  uint8_t mode;
   uint8_t cycles;
   uint8_t size;
+  bool indexed;
+  bool cycle_cross;
 } jit_instruction_t;
 
+typedef struct jit_block {
+  const uint8_t* source;  // Host memory the block was decoded from
+  uint16_t pc;
+  uint8_t length;
+  jit_instruction_t code[];
+} jit_block_t;
+
 // Functions
 cpu_t* cpu_init();
 void cpu_nmi(cpu_t* cpu, bool nmi);
@@ -123,6 +149,21 @@ void cpu_reset(cpu_t* cpu);
 void cpu_deinit(cpu_t* cpu);
 bool cpu_cycle(cpu_t* cpu);
 
+/**
+ * Runs whole instructions from *cycles until it reaches end or *deadline,
+ * which may be lowered meanwhile (e.g. by a mapper callback on a register
+ * access). Cycles the last instruction spends busy past that point are left in
+ * busy. Returns true if the CPU trapped.
+ */
+bool cpu_run(cpu_t* cpu, uint64_t* cycles, uint64_t end,
+             const uint64_t* deadline);
+
+/**
+ * Discards all decoded blocks held by the CPU. Must be called before the
+ * memory they were decoded from is freed, e.g. when a new ROM is loaded.
+ */
+void cpu_jit_flush(cpu_t* cpu);
+
 void cpu_interrupt(cpu_t* cpu, interrupt_type_t type);
 
 typedef enum {
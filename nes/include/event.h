@@ -0,0 +1,77 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * event.h
+ *
+ * The queue of upcoming events of the system, shared by all of its devices.
+ * Every kind of event is scheduled at most once, at a time in master clock
+ * cycles (see region.h): the last master clock cycle of the device cycle in
+ * which the event happens. The CPU runs ahead up to the first event, see
+ * sys.c.
+ */
+
+#define EVENT_NEVER UINT64_MAX
+
+/**
+ * Kinds of events.
+ */
+typedef enum {
+  EV_PPU_NMI,    // The NMI output of the PPU may change
+  EV_APU_FRAME,  // A frame counter step (and IRQ), or a delayed reset
+  EV_COUNT
+} event_kind_t;
+
+/**
+ * There are only a handful of kinds, so the queue is a table of their times.
+ */
+typedef struct {
+  uint64_t times[EV_COUNT];  // EVENT_NEVER if not scheduled
+} event_queue_t;
+
+/**
+ * Allocates a queue with no events scheduled.
+ */
+event_queue_t* event_init(void);
+
+/**
+ * Schedules the event of the given kind at the given time, replacing any
+ * earlier schedule of it. EVENT_NEVER cancels it.
+ */
+void event_schedule(event_queue_t* events, event_kind_t kind, uint64_t time);
+
+/**
+ * Returns the time of the first event, or EVENT_NEVER.
+ */
+uint64_t event_next(event_queue_t* events);
+
+/**
+ * Frees the queue.
+ */
+void event_deinit(event_queue_t* events);
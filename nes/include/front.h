@@ -65,10 +65,12 @@ typedef struct {
   uint8_t scale;
 } front_t;
 
+#ifndef HEADLESS
 /**
  * Shows a system-dependent dialog to select a ROM file.
  */
 char* front_rom_dialog(void);
+#endif
 
 /**
  * Allocates the memory for a front.
@@ -0,0 +1,79 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apu.h"
+#include "front.h"
+#include "front_impl.h"
+
+/**
+ * front_headless.h
+ *
+ * Headless front, which runs the system as fast as possible for a number of
+ * frames without displaying anything, then optionally dumps the final frame
+ * and the audio output to files.
+ */
+
+#define FRONT_HEADLESS_DEFAULT_FRAMES 600
+
+/**
+ * Headless-specific front data.
+ */
+typedef struct {
+  // Options, set before running
+  uint32_t frames;
+  uint32_t render_every;    // Draws every nth frame, and always the last one
+  const char* screen_path;  // PPM file for the final frame, or NULL
+  const char* audio_path;   // WAV file for the audio, or NULL
+  apu_output_t audio_output;
+
+  // Audio
+  FILE* audio;
+  uint32_t audio_samples;
+
+  // Common data
+  front_t* front;
+} front_headless_impl_t;
+
+/**
+ * Creates an instance of a headless front.
+ */
+front_headless_impl_t* front_headless_impl_init(front_t* front);
+
+/**
+ * Runs the system for the configured number of frames and writes the
+ * requested dumps.
+ */
+void front_headless_impl_run(front_headless_impl_t* impl);
+
+/**
+ * Frees any memory allocated with the headless front.
+ */
+void front_headless_impl_deinit(front_headless_impl_t* impl);
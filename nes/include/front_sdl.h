@@ -30,7 +30,10 @@
 
 #include "front.h"
 #include "front_impl.h"
+#include "front_sdl_emu.h"
+#include "palette.h"
 #include "ppu.h"
+#include "profiler.h"
 
 /**
  * front_sdl.h
@@ -48,6 +51,9 @@ typedef struct {
   SDL_Texture* ui;
   SDL_Texture* screen_tex;
   SDL_Texture* prescaled_tex;
+  palette_t palette;          // Converts frames for screen_tex
+  const ppu_frame_t* frame;  // Last frame presented
+  uint64_t frame_number;
 
   // Fullscreen
   SDL_Rect* screen_rect;
@@ -56,6 +62,17 @@ typedef struct {
   // Audio
   SDL_AudioDeviceID audio_device;
 
+  // Emulation, on its own thread while running
+  front_sdl_emu_t* emu;
+  front_sdl_emu_pacing_t pacing;  // Set before running
+
+  // Profiling of this thread, and the last profile sent by the emulation
+  // thread, which has its own
+  profiler_t* profiler;
+#ifdef PROFILER
+  float sys_times[PROFILER_NUM_POINTS];
+#endif
+
   // Mouse
   int32_t mouse_x;
   int32_t mouse_y;
@@ -0,0 +1,166 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ring.h"
+#include "sys.h"
+
+/**
+ * front_sdl_emu.h
+ *
+ * The emulation thread of the SDL front. It owns the system and runs it in
+ * real time, taking commands from the UI thread through a queue. Frames go
+ * back to the UI through the PPU frame buffers (see ppu_frame_acquire), and
+ * errors through another queue. Audio goes straight to the audio callback
+ * through a queue of its own. None of these queues ever block.
+ */
+
+#define FRONT_SDL_EMU_COMMANDS 64
+#define FRONT_SDL_EMU_REPORTS 16
+// Samples queued for the audio callback at most, which bounds the latency,
+// and the number kept queued by rate control
+#define FRONT_SDL_EMU_AUDIO 2048
+#define FRONT_SDL_EMU_AUDIO_TARGET 1024
+// Time run at once at most, in ms. When the system cannot keep up, it runs
+// slower rather than in ever longer bursts.
+#define FRONT_SDL_EMU_MAX_TICKS 20
+
+/**
+ * Clocks pacing the emulation thread.
+ */
+typedef enum {
+  FEP_TICKS,  // Runs for the time passed, see SDL_GetTicks
+  FEP_AUDIO   // Runs for as long as the audio queue is below its target
+} front_sdl_emu_pacing_t;
+
+/**
+ * Commands for the emulation thread.
+ */
+typedef enum {
+  FEC_LOAD,    // Loads the ROM at path, which the thread frees
+  FEC_START,   // Starts or resumes the system
+  FEC_STOP,    // Stops and resets the system
+  FEC_PAUSE,   // Pauses the system
+  FEC_TEST,    // Runs the tests binary
+  FEC_BUTTON,  // Forwards a key event to the SDL controller driver
+  FEC_QUIT     // Ends the thread
+} front_sdl_emu_command_type_t;
+
+typedef struct {
+  front_sdl_emu_command_type_t type;
+  char* path;       // FEC_LOAD
+  SDL_Event event;  // FEC_BUTTON
+} front_sdl_emu_command_t;
+
+/**
+ * Statistics of the audio queue.
+ */
+typedef struct {
+  uint32_t queued;     // Samples waiting for the audio callback
+  uint32_t overruns;   // Buffers from the APU that did not fit in the queue
+  uint32_t underruns;  // Callbacks that found too few samples while running
+} front_sdl_emu_audio_stats_t;
+
+/**
+ * Sent to the UI thread when a command fails, or when the system stops by
+ * itself. With PROFILER, also sent with SS_NONE whenever the profiler of the
+ * system has a new average, which only this thread may read.
+ */
+typedef struct {
+  sys_status_t status;
+  uint8_t opcode;  // Last opcode run, for CPU errors
+#ifdef PROFILER
+  float times[PROFILER_NUM_POINTS];  // See profiler_get_times, for SS_NONE
+#endif
+} front_sdl_emu_report_t;
+
+typedef struct {
+  sys_t* sys;
+  SDL_Thread* thread;
+  front_sdl_emu_pacing_t pacing;
+  // Held by the thread while it uses the system. The UI only takes it to show
+  // the state of the system in the debugging tabs.
+  SDL_mutex* lock;
+
+  ring_t* commands;  // Of front_sdl_emu_command_t, from the UI
+  ring_t* reports;   // Of front_sdl_emu_report_t, to the UI
+  ring_t* audio;     // Of samples in the APU format, to the audio callback
+  uint32_t audio_sample_size;
+  uint8_t audio_last[sizeof(apu_buffer_t)];  // Repeated on underruns
+  // Counters of front_sdl_emu_audio_stats_t, only accessed atomically
+  uint32_t audio_overruns;
+  uint32_t audio_underruns;
+
+  // Copies of the system state for the UI, only accessed atomically
+  bool running;
+  sys_status_t status;
+} front_sdl_emu_t;
+
+/**
+ * Starts the emulation thread for the given system, paced by the given clock.
+ * The system must not be used by any other thread afterwards, except while
+ * holding the lock. Its audio output must be configured before, and needs
+ * rate control for FEP_AUDIO.
+ */
+front_sdl_emu_t* front_sdl_emu_init(sys_t* sys,
+                                    front_sdl_emu_pacing_t pacing);
+
+/**
+ * Queues a command for the emulation thread. Returns false if the queue is
+ * full, in which case the command is dropped (and its path freed).
+ */
+bool front_sdl_emu_command(front_sdl_emu_t* emu,
+                           front_sdl_emu_command_type_t type, char* path,
+                           SDL_Event* event);
+
+/**
+ * Return whether the system was running, and its status, when last checked by
+ * the thread.
+ */
+bool front_sdl_emu_running(front_sdl_emu_t* emu);
+sys_status_t front_sdl_emu_status(front_sdl_emu_t* emu);
+
+/**
+ * Fills a buffer with len samples of queued audio, in the output format of the
+ * APU. Only called by the audio callback.
+ */
+void front_sdl_emu_audio(front_sdl_emu_t* emu, void* buffer, uint32_t len);
+
+/**
+ * Returns the current statistics of the audio queue.
+ */
+void front_sdl_emu_audio_stats(front_sdl_emu_t* emu,
+                               front_sdl_emu_audio_stats_t* stats);
+
+/**
+ * Stops the emulation thread, waits for it to finish, and frees the queues.
+ * The system is left as it is.
+ */
+void front_sdl_emu_deinit(front_sdl_emu_t* emu);
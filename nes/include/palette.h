@@ -0,0 +1,67 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "ppu.h"
+
+/**
+ * palette.h
+ *
+ * Output palettes, which convert the NES colour indices drawn by the PPU to a
+ * host pixel format. Conversion is only needed for frames that are presented.
+ */
+
+/**
+ * Pixel formats available.
+ */
+typedef enum {
+  PF_ARGB8888,
+  PF_RGB565,
+  PF_YUY2  // Packed 4:2:2, each pair of pixels shares U and V
+} palette_format_t;
+
+/**
+ * Colour of every NES colour index in the pixel format, for every emphasis.
+ * YUY2 colours are stored as Y | U << 8 | V << 16.
+ */
+typedef struct {
+  palette_format_t format;
+  uint32_t colours[PPU_EMPHASIS_COUNT][64];
+} palette_t;
+
+/**
+ * Builds an output palette from the 64 NES colours in ARGB8888.
+ */
+void palette_init(palette_t* palette, palette_format_t format,
+                  const uint32_t* argb);
+
+/**
+ * Converts a frame drawn by the PPU, writing a row of pixels every pitch bytes.
+ */
+void palette_convert(const palette_t* palette, const ppu_frame_t* frame,
+                     void* pixels, int pitch);
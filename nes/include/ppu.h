@@ -42,14 +42,27 @@
 // Dimensions of the PPU picture (internal)
 #define PPU_SCANLINES 262
 #define PPU_CYCLES 341
+#define PPU_SCREEN_WIDTH 256
+#define PPU_SCREEN_HEIGHT 240
 #define PPU_SCREEN_SIZE 61440
-#define PPU_SCREEN_SIZE_BYTES (61440 << 2)
+
+// Combinations of the colour emphasis bits in PPUMASK
+#define PPU_EMPHASIS_COUNT 8
+
+// Frames drawn into by the PPU, see ppu_frame_acquire
+#define PPU_FRAMES 3
+#define PPU_FRAME_FRESH 0x4  // Set in frame_ready until acquired
 
 // Important scanlines
 #define PPU_SL_VISIBLE 0
 #define PPU_SL_POSTRENDER 240
+#define PPU_SL_VBLANK 241
 #define PPU_SL_PRERENDER 261
 
+// Flags of the pixels in the sprite line buffer
+#define PPU_SPR_PRIORITY 0x20  // Behind the background
+#define PPU_SPR_SPRITE0 0x40
+
 // CPU mapped addresses
 #define PPU_ADDR_PPUCTRL 0x0
 #define PPU_ADDR_PPUMASK 0x1
@@ -125,6 +138,15 @@ typedef struct __attribute__((packed)) {
   uint16_t pattern;
 } oam_state_t;
 
+/**
+ * A frame drawn by the PPU.
+ */
+typedef struct {
+  uint8_t screen[PPU_SCREEN_SIZE];      // Index in nes_palette, see palette.h
+  uint8_t emphasis[PPU_SCREEN_HEIGHT];  // PPUMASK emphasis of lines
+  uint64_t number;                      // Increases with every frame published
+} ppu_frame_t;
+
 /**
  * The main PPU struct. Holds internal state, memory, and registers.
  */
@@ -161,7 +183,7 @@ typedef struct ppu {
       uint8_t show_left_sprites : 1;
       uint8_t show_bg : 1;
       uint8_t show_sprites : 1;
-      uint8_t : 3;
+      uint8_t emphasis : 3;
     } flags;
     /*struct __attribute__((packed)) {
       uint8_t : 5;
@@ -182,6 +204,7 @@ typedef struct ppu {
   uint8_t mask_show_left_sprites;
   uint8_t mask_show_bg;
   uint8_t mask_show_sprites;
+  uint8_t mask_emphasis;
 
   // Register PPUSTATUS
   union {
@@ -203,6 +226,7 @@ typedef struct ppu {
   // Status
   uint16_t cycle;
   uint16_t scanline;
+  uint64_t frames;  // Number of times VBlank was entered
   bool frame_odd;
 
   // Special R/W conditions
@@ -222,8 +246,8 @@ typedef struct ppu {
   // Palette
   uint32_t nes_palette_direct[64];  // In ARGB8888 format
   // uint32_t nes_palette_ntsc[64][3]; // ARGB8888
-  uint32_t palette_cache[32];  // ARGB8888
-  uint8_t palette[32];         // Index in nes_palette, cached in palette_cache
+  uint8_t palette_cache[32];  // Index in nes_palette as shown, in greyscale
+  uint8_t palette[32];        // Index in nes_palette
 
   // Rendering
   uint16_t io_addr;
@@ -231,8 +255,7 @@ typedef struct ppu {
   // Background
   uint8_t ren_nt;
   uint8_t ren_at;
-  uint8_t ren_bg_low;
-  uint8_t ren_bg_high;
+  uint32_t ren_bg;  // Pattern bytes, decoded as in chr_tile_t
   uint64_t tile_data;
 
   // Sprite rendering
@@ -241,27 +264,39 @@ typedef struct ppu {
     uint8_t raw[256];
   } oam;
   uint8_t oam_address;
+  // Sprites in range of every visible scanline, as masks with one bit per OAM
+  // entry. Updated whenever the OAM or the sprite size changes.
+  uint64_t oam_lines[PPU_SCREEN_HEIGHT];
   // Secondary (rendering on the next scanline)
   uint16_t spr_count_next;
   uint16_t spr_row_next[8];
   uint8_t spr_pos_next[8];
   uint8_t spr_priority_next[8];
   uint8_t spr_index_next[8];
-  // Tertiary (rendering on the current scanline)
+  // Tertiary (rendering on the current scanline), drawn into a line buffer as
+  // they are fetched. Every pixel holds the palette index of the front-most
+  // opaque sprite, with the PPU_SPR_* flags, or 0 if transparent.
   uint16_t spr_count;
-  uint32_t spr_pat[8];
-  uint8_t spr_pos[8];
-  uint8_t spr_priority[8];
-  uint8_t spr_index[8];
+  uint8_t spr_line[PPU_SCREEN_WIDTH];
+  bool spr_line_zero;  // Sprite 0 is in the line buffer
 
   // Sprite debugging
   uint16_t spr_count_max;
 
   // Visual output
   ppu_driver_t driver;
+  // Whether pixels are drawn. Otherwise the PPU only keeps their side effects
+  // (sprite 0 hits) and does not publish the frame. Set between frames.
+  bool render;
   bool flip;
-  uint32_t screen[PPU_SCREEN_SIZE];
-  uint8_t screen_dbg[PPU_SCREEN_SIZE];
+  // Triple buffer of frames. Indices of the frame being drawn, the newest one
+  // published (with PPU_FRAME_FRESH until acquired, only accessed atomically)
+  // and the one last acquired.
+  ppu_frame_t frame_buffers[PPU_FRAMES];
+  uint8_t frame_back;
+  uint8_t frame_ready;
+  uint8_t frame_front;
+  uint64_t frame_number;
 } ppu_t;
 
 /**
@@ -290,6 +325,34 @@ void ppu_power(ppu_t* ppu);
  */
 void ppu_cycle(ppu_t* ppu);
 
+/**
+ * Executes the given number of PPU cycles.
+ */
+void ppu_run(ppu_t* ppu, uint32_t cycles);
+
+/**
+ * Returns the number of PPU cycles that can be run before the NMI output may
+ * change, without any register accesses in between. The output may change
+ * during the last of these cycles.
+ */
+uint32_t ppu_nmi_deadline(ppu_t* ppu);
+
+/**
+ * Returns the number of PPU cycles that can be run before entering VBlank.
+ * VBlank may be entered during the last of these cycles, or later if the
+ * frame turns out to be one cycle longer than assumed.
+ */
+uint32_t ppu_vblank_deadline(ppu_t* ppu);
+
+/**
+ * Returns the newest frame published by the PPU, which is done as soon as its
+ * last visible line is drawn. The frame stays intact until the next call, and
+ * is replaced with the frame last returned if none was published since. It
+ * never blocks or copies, so it can be called from another thread than the
+ * one running the PPU, as long as it is always the same one.
+ */
+const ppu_frame_t* ppu_frame_acquire(ppu_t* ppu);
+
 /**
  * Frees any dynamic memory allocated for the PPU.
  */
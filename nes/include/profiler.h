@@ -25,6 +25,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 /**
  * profiler.h
  *
@@ -54,11 +56,44 @@ typedef enum {
 
 #ifdef PROFILER
 #define PROFILER_NUM_POINTS PROF_END
-#define PROFILER_POINT(P) profiler_set_point(PROF_##P);
-void profiler_set_point(profiler_point_t p);
 #else
 #define PROFILER_NUM_POINTS 0
-#define PROFILER_POINT(P)
 #endif
 
-float* profiler_get_times();
+/**
+ * Accumulates the time spent between points. A profiler must only be used by
+ * one thread, e.g. the system and the front each have their own.
+ */
+typedef struct {
+#ifdef PROFILER
+  uint8_t samples;
+  uint32_t ticks[PROFILER_NUM_POINTS];
+  float times[PROFILER_NUM_POINTS];
+  int last_tick;
+#else
+  float times[1];
+#endif
+} profiler_t;
+
+/**
+ * Allocates memory for a profiler.
+ */
+profiler_t* profiler_init(void);
+
+/**
+ * Frees the memory for a profiler.
+ */
+void profiler_deinit(profiler_t* profiler);
+
+#ifdef PROFILER
+#define PROFILER_POINT(PROF, P) profiler_set_point(PROF, PROF_##P);
+void profiler_set_point(profiler_t* profiler, profiler_point_t p);
+#else
+#define PROFILER_POINT(PROF, P)
+#endif
+
+/**
+ * Returns the fraction of time spent before each point, averaged over a
+ * number of calls.
+ */
+float* profiler_get_times(profiler_t* profiler);
@@ -38,8 +38,25 @@
  */
 typedef enum { R_NTSC, R_PAL, R_DENDY, R_RGB3, R_RGB4, R_RGB5 } region;
 
+/**
+ * Clock timing of a region. All of the clocks are derived from the master
+ * clock, whose frequency is given as a fraction to keep it exact.
+ */
+typedef struct {
+  uint64_t master_hz_numerator;
+  uint64_t master_hz_denominator;
+  uint32_t cpu_divider;  // Master clock cycles per CPU cycle
+  uint32_t ppu_divider;  // Master clock cycles per PPU cycle
+  uint32_t apu_divider;  // Master clock cycles per APU cycle
+} region_timing_t;
+
 /**
  * Returns the screen size appropriate for the set region.
  */
 uint32_t region_screen_width(region region);
 uint32_t region_screen_height(region region);
+
+/**
+ * Returns the clock timing of the set region.
+ */
+region_timing_t region_timing(region region);
@@ -0,0 +1,74 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * ring.h
+ *
+ * A lock-free ring buffer of fixed size items, for one producer thread and one
+ * consumer thread. Each side only writes its own index, and publishes it with
+ * release ordering once the items are written or read.
+ */
+
+typedef struct {
+  uint8_t* items;
+  uint32_t item_size;
+  uint32_t capacity;  // A power of two
+  uint32_t head;      // Items ever pushed, only written by the producer
+  uint32_t tail;      // Items ever popped, only written by the consumer
+} ring_t;
+
+/**
+ * Allocates a ring holding up to the given number of items, rounded up to a
+ * power of two.
+ */
+ring_t* ring_init(uint32_t capacity, uint32_t item_size);
+
+/**
+ * Pushes up to count items, as many as fit. Returns the number pushed. Only
+ * called by the producer.
+ */
+uint32_t ring_push(ring_t* ring, const void* items, uint32_t count);
+
+/**
+ * Pops up to count items, as many as are queued. Returns the number popped.
+ * Only called by the consumer.
+ */
+uint32_t ring_pop(ring_t* ring, void* items, uint32_t count);
+
+/**
+ * Returns the number of items queued. Exact for the consumer, an upper bound
+ * for the producer, and a snapshot for any other thread.
+ */
+uint32_t ring_size(ring_t* ring);
+
+/**
+ * Frees the ring. Neither side may use it any more.
+ */
+void ring_deinit(ring_t* ring);
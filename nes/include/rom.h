@@ -36,6 +36,8 @@
 #define SRAM_SIZE 0x2000
 #define PPU_TABLES_SIZE 0x3000
 #define PPU_PALETTES_SIZE 0x20
+#define CHR_RAM_SIZE 0x2000
+#define CHR_TILE_SIZE 16
 
 typedef enum {
   RE_SUCCESS,
@@ -145,6 +147,18 @@ typedef struct __attribute__((packed)) {
   uint8_t : 8;
 } rom_header_t;
 
+/**
+ * Pattern table tile with every byte spread to bit 0 of 8 nibbles, leftmost
+ * pixel in the top nibble, both as stored and flipped horizontally. A row of 4
+ * bit pixels is the low plane byte ORed with the high plane byte shifted left.
+ * Writes to the pattern tables mark the tile dirty, and it is decoded again
+ * when next read.
+ */
+typedef struct {
+  uint32_t planes[CHR_TILE_SIZE][2];  // Indexed by byte, then by flip
+  bool dirty;
+} chr_tile_t;
+
 // https://en.wikibooks.org/wiki/NES_Programming/Memory_Map
 typedef struct {
   // CPU
@@ -155,12 +169,31 @@ typedef struct {
 
   // PPU
   uint8_t vram[VIDEO_RAM_SIZE];
-  uint8_t* chr_rom;  // NULL if not present
-  uint8_t* chr_ram;  // NULL if not present
+  uint8_t* chr_rom;       // NULL if not present
+  uint8_t* chr_ram;       // NULL if not present
+  chr_tile_t* chr_tiles;  // Decoded CHR ROM, or CHR RAM if there is none
 } memory_t;
 
+/**
+ * CPU memory map page. Pages backed by plain memory point directly at the
+ * host memory of their first byte; pages containing I/O registers, mapper
+ * registers or unmapped space have NULL pointers and go through the full
+ * decoding in mmap_cpu_read / mmap_cpu_write.
+ */
+#define MMAP_PAGE_SHIFT 8
+#define MMAP_PAGE_SIZE (1 << MMAP_PAGE_SHIFT)
+#define MMAP_PAGES (0x10000 >> MMAP_PAGE_SHIFT)
+#define MMAP_PAGE(A) ((A) >> MMAP_PAGE_SHIFT)
+#define MMAP_OFFSET(A) ((A) & (MMAP_PAGE_SIZE - 1))
+
+typedef struct {
+  uint8_t* read;   // NULL if reads have side effects
+  uint8_t* write;  // NULL if writes have side effects or are ignored
+} mmap_page_t;
+
 struct controller;
 struct cpu;
+struct jit_block;
 struct ppu;
 struct apu;
 
@@ -184,12 +217,30 @@ typedef struct {
     uint8_t* ppu_nametable0;
     uint8_t* ppu_nametable1;
     // uint8_t* ppu_palettes;
+
+    // Decoded tiles of ppu_pattable0 / ppu_pattable1, switched along with them
+    chr_tile_t* ppu_pattiles0;
+    chr_tile_t* ppu_pattiles1;
   } mapped;
 
+  // Page table derived from the mapped struct, see mmap_cpu_remap
+  mmap_page_t pages[MMAP_PAGES];
+
+  // State specific to the mapper number, owned by the functions in MAPPERS
+  void* data;
+
+  // Blocks decoded by the CPU, indexed by PRG ROM offset
+  struct jit_block** jit_blocks;
+
   struct controller* controller;
   struct cpu* cpu;
   struct ppu* ppu;
   struct apu* apu;
+
+  // Called before the CPU accesses any of the registers in $2000 - $401F, so
+  // that the devices can be brought up to date with the CPU
+  void (*sync)(void* context);
+  void* sync_context;
 } mapper_t;
 
 /*
@@ -241,8 +292,26 @@ void mmap_cpu_write(mapper_t* mapper, uint16_t address, uint8_t val);
 uint8_t mmap_cpu_read(mapper_t* mapper, uint16_t address, bool dummy);
 void mmap_cpu_dma(mapper_t* mapper, uint8_t address, uint8_t* buf);
 
+/**
+ * Rebuilds the CPU page table from the mapped struct. Must be called by
+ * mappers whenever they change the CPU-visible banks.
+ */
+void mmap_cpu_remap(mapper_t* mapper);
+
+/**
+ * Returns a pointer to the host memory currently backing the given CPU
+ * address, or NULL if the address is not plain memory (I/O registers,
+ * unmapped space). Reading through this pointer has no side effects.
+ */
+uint8_t* mmap_cpu_host(mapper_t* mapper, uint16_t address);
+
 /**
  * Read / write from within the PPU
  */
 void mmap_ppu_write(mapper_t* mapper, uint16_t address, uint8_t val);
 uint8_t mmap_ppu_read(mapper_t* mapper, uint16_t address);
+
+/**
+ * Returns a byte from the pattern tables, decoded as in chr_tile_t
+ */
+uint32_t mmap_ppu_pattern(mapper_t* mapper, uint16_t address, bool flip_h);
@@ -31,7 +31,9 @@
 #include "apu_typedefs.h"
 #include "controller.h"
 #include "cpu.h"
+#include "event.h"
 #include "ppu.h"
+#include "profiler.h"
 #include "region.h"
 #include "rom.h"
 
@@ -61,12 +63,27 @@ typedef enum {
  * The main system struct, which holds all of the components.
  */
 typedef struct {
-  double clock;
+  // Master clock, in master clock cycles since power on
+  uint64_t clock;
+  uint64_t clock_remainder;  // Fraction of a master clock cycle, see sys_run
+  region_timing_t timing;
+
+  // Scheduler state
+  uint64_t cycles;        // Cycles run by the CPU
+  uint64_t ppu_cycles;    // Cycles run by the PPU
+  uint64_t apu_cycles;    // Cycles run by the APU
+  uint64_t deadline;      // First CPU cycle which has to run in lockstep
+  event_queue_t* events;  // Shared with the devices
+  void* audio_context;
+  apu_enqueue_audio_t enqueue_audio;
+  apu_get_queue_size_t get_queue_size;
+
   controller_t* controller;
   cpu_t* cpu;
   ppu_t* ppu;
   mapper_t* mapper;
   apu_t* apu;
+  profiler_t* profiler;
   region region;
 
   sys_status_t status;
@@ -86,6 +103,28 @@ bool sys_run(sys_t* sys, uint32_t ms, void* context,
              apu_enqueue_audio_t enqueue_audio,
              apu_get_queue_size_t get_queue_size);
 
+/**
+ * Sets the callbacks used by sys_run_cycles and sys_run_frame to output
+ * audio. The callbacks may be NULL to discard audio.
+ */
+void sys_audio(sys_t* sys, void* context, apu_enqueue_audio_t enqueue_audio,
+               apu_get_queue_size_t get_queue_size);
+
+/**
+ * Advances the system by the given number of CPU cycles, as fast as possible.
+ * The controller drivers are not polled. Returns true if the system stopped
+ * for any reason.
+ */
+bool sys_run_cycles(sys_t* sys, uint64_t cycles);
+
+/**
+ * Advances the system until the PPU enters VBlank, as fast as possible. The
+ * frame has been published (see ppu_frame_acquire) when this returns. The
+ * controller drivers are not polled. Returns true if the system stopped for
+ * any reason.
+ */
+bool sys_run_frame(sys_t* sys);
+
 /**
  * Loads a ROM with the given path.
  */
@@ -26,13 +26,26 @@
 #include <math.h>
 #include <stdio.h>
 
+#if defined(__SSE2__) && !defined(NO_SIMD)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && !defined(NO_SIMD)
+#include <arm_neon.h>
+#endif
+
 #include "apu.h"
 #include "cpu.h"
 
-apu_t* apu_init(void) {
+static void apu_frame_counter_schedule(apu_t* apu, uint64_t cycle);
+
+apu_t* apu_init(event_queue_t* events, uint64_t master_hz_numerator,
+                uint64_t master_hz_denominator, uint32_t divider) {
   apu_t* apu = calloc(1, sizeof(apu_t));
-  apu->sample_skips = 0.0;
-  apu->buffer_cursor = 0;
+  apu->events = events;
+  apu->divider = divider;
+  apu->cycles = 0;
+  apu->clock_rate = (double)master_hz_numerator /
+                    ((double)master_hz_denominator * divider);
+  apu->blip = NULL;
   apu->is_even_cycle = false;
 
   // Set up shift register
@@ -55,6 +68,14 @@ apu_t* apu_init(void) {
     apu->lookup_tnd_table[i] = 163.67 / (24329.0 / i + 100);
   }
 
+  apu_frame_counter_schedule(apu, 0);
+
+  apu_output_t config = {.rate = APU_ACTUAL_SAMPLE_RATE,
+                         .format = AF_F32,
+                         .quality = AQ_MEDIUM,
+                         .queue_target = 0};
+  apu_configure_output(apu, &config);
+
   return apu;
 }
 
@@ -68,6 +89,8 @@ static void apu_frame_counter_clock_half_frame(apu_t* apu);
 
 static void apu_frame_counter_clock_quarter_frame(apu_t* apu);
 
+static void apu_update_output(apu_t* apu);
+
 void apu_mem_write(apu_t* apu, uint16_t address, uint8_t val) {
   switch (address) {
     case 0x4000: {
@@ -262,10 +285,14 @@ void apu_mem_write(apu_t* apu, uint16_t address, uint8_t val) {
         apu_frame_counter_clock_half_frame(apu);
         apu_frame_counter_clock_quarter_frame(apu);
       }
+      apu_frame_counter_schedule(apu, apu->cycles);
     } break;
     default:
       break;
   }
+
+  // Any register can change the output, e.g. through the volume
+  apu_update_output(apu);
 }
 
 uint8_t apu_mem_read(apu_t* apu, uint16_t address) {
@@ -299,18 +326,28 @@ uint8_t apu_mem_read(apu_t* apu, uint16_t address) {
 
 // ----- TIMER -----
 static void apu_timer_clock(apu_t* apu) {
+  bool clocked = false;
   if (apu->is_even_cycle) {
-    apu_unit_timer_clock(&apu->channel_pulse1.timer, &apu->channel_pulse1,
-                         apu_channel_pulse_sequencer_clock);
-    apu_unit_timer_clock(&apu->channel_pulse2.timer, &apu->channel_pulse2,
-                         apu_channel_pulse_sequencer_clock);
-    apu_unit_timer_clock(&apu->channel_noise.timer, &apu->channel_noise,
-                         apu_channel_noise_lfsr_clock);
+    clocked |=
+        apu_unit_timer_clock(&apu->channel_pulse1.timer, &apu->channel_pulse1,
+                             apu_channel_pulse_sequencer_clock);
+    clocked |=
+        apu_unit_timer_clock(&apu->channel_pulse2.timer, &apu->channel_pulse2,
+                             apu_channel_pulse_sequencer_clock);
+    clocked |=
+        apu_unit_timer_clock(&apu->channel_noise.timer, &apu->channel_noise,
+                             apu_channel_noise_lfsr_clock);
     apu_unit_timer_clock(&apu->channel_dmc.timer, NULL, NULL);
   }
 
-  apu_unit_timer_clock(&apu->channel_triangle.timer, &apu->channel_triangle,
-                       apu_channel_triangle_sequencer_clock);
+  clocked |= apu_unit_timer_clock(&apu->channel_triangle.timer,
+                                  &apu->channel_triangle,
+                                  apu_channel_triangle_sequencer_clock);
+
+  // The output only changes when a sequencer steps
+  if (clocked) {
+    apu_update_output(apu);
+  }
 }
 
 // ----- FRAME COUNTER -----
@@ -330,6 +367,8 @@ static void apu_frame_counter_clock_half_frame(apu_t* apu) {
 
   apu_unit_sweep_clock(&apu->channel_pulse1.sweep, true);
   apu_unit_sweep_clock(&apu->channel_pulse2.sweep, false);
+
+  apu_update_output(apu);
 }
 
 static void apu_frame_counter_clock_quarter_frame(apu_t* apu) {
@@ -339,6 +378,8 @@ static void apu_frame_counter_clock_quarter_frame(apu_t* apu) {
   apu_unit_envelope_clock(&apu->channel_noise.envelope);
 
   apu_channel_triangle_linear_counter_clock(&apu->channel_triangle);
+
+  apu_update_output(apu);
 }
 
 static void apu_frame_counter_interrupt(apu_t* apu) {
@@ -356,10 +397,60 @@ static void apu_frame_counter_reset_now(apu_t* apu) {
   apu->frame_counter.reset_queue_divider = 0;
 }
 
+// Cycles before the one in which the frame counter does more than count
+static uint32_t apu_frame_counter_distance(apu_t* apu) {
+  const uint16_t* sequence = apu->frame_counter.mode_flag
+                                 ? FRAME_COUNTER_SEQUENCE_M1
+                                 : FRAME_COUNTER_SEQUENCE_M0;
+  uint8_t length = apu->frame_counter.mode_flag ? FC_SEQ_1_LEN : FC_SEQ_0_LEN;
+  uint32_t distance = UINT32_MAX;
+  if (apu->frame_counter.cycle_index < length &&
+      apu->frame_counter.cycles <= sequence[apu->frame_counter.cycle_index]) {
+    distance =
+        sequence[apu->frame_counter.cycle_index] - apu->frame_counter.cycles;
+  }
+  if (apu->frame_counter.reset_queued &&
+      apu->frame_counter.reset_queue_divider - 1u < distance) {
+    distance = apu->frame_counter.reset_queue_divider - 1u;
+  }
+  return distance;
+}
+
+// Schedules the next cycle in which the frame counter does more than count,
+// from the given cycle on
+static void apu_frame_counter_schedule(apu_t* apu, uint64_t cycle) {
+  uint32_t distance = apu_frame_counter_distance(apu);
+  uint64_t time = EVENT_NEVER;
+  apu->frame_counter.event = EVENT_NEVER;
+  if (distance != UINT32_MAX) {
+    apu->frame_counter.event = cycle + distance;
+    time = (apu->frame_counter.event + 1) * apu->divider - 1;
+  }
+  event_schedule(apu->events, EV_APU_FRAME, time);
+}
+
+// Runs cycles in which the frame counter only counts
+static void apu_frame_counter_count(apu_t* apu, uint32_t cycles) {
+  apu->frame_counter.cycles += cycles;
+  if (apu->frame_counter.reset_queued) {
+    apu->frame_counter.reset_queue_divider -= cycles;
+  }
+}
+
+// Runs the frame counter for the current cycle
 static void apu_frame_counter_clock(apu_t* apu) {
-  if (apu->frame_counter.mode_flag == 0) {
-    if (apu->frame_counter.cycles ==
-        FRAME_COUNTER_SEQUENCE_M0[apu->frame_counter.cycle_index]) {
+  if (apu->cycles != apu->frame_counter.event) {
+    apu_frame_counter_count(apu, 1);
+    return;
+  }
+
+  const uint16_t* sequence = apu->frame_counter.mode_flag
+                                 ? FRAME_COUNTER_SEQUENCE_M1
+                                 : FRAME_COUNTER_SEQUENCE_M0;
+  uint8_t length = apu->frame_counter.mode_flag ? FC_SEQ_1_LEN : FC_SEQ_0_LEN;
+  if (apu->frame_counter.cycle_index < length &&
+      apu->frame_counter.cycles == sequence[apu->frame_counter.cycle_index]) {
+    if (apu->frame_counter.mode_flag == 0) {
       switch (apu->frame_counter.cycle_index) {
         case 0:
         case 2:
@@ -376,10 +467,7 @@ static void apu_frame_counter_clock(apu_t* apu) {
           apu_frame_counter_interrupt(apu);
           break;
       }
-    }
-  } else {
-    if (apu->frame_counter.cycles ==
-        FRAME_COUNTER_SEQUENCE_M1[apu->frame_counter.cycle_index]) {
+    } else {
       switch (apu->frame_counter.cycle_index) {
         case 0:
         case 2:
@@ -392,33 +480,21 @@ static void apu_frame_counter_clock(apu_t* apu) {
           break;
       }
     }
-  }
 
-  // Reset the frame counter if necessary. Statement could be merged with above.
-  if (apu->frame_counter.mode_flag == 0 &&
-      apu->frame_counter.cycles ==
-          FRAME_COUNTER_SEQUENCE_M0[apu->frame_counter.cycle_index]) {
-    apu->frame_counter.cycle_index++;
-    if (apu->frame_counter.cycle_index >= FC_SEQ_0_LEN) {
-      apu_frame_counter_reset_now(apu);
-    }
-  } else if (apu->frame_counter.mode_flag == 1 &&
-             apu->frame_counter.cycles ==
-                 FRAME_COUNTER_SEQUENCE_M1[apu->frame_counter.cycle_index]) {
     apu->frame_counter.cycle_index++;
-    if (apu->frame_counter.cycle_index >= FC_SEQ_1_LEN) {
+    if (apu->frame_counter.cycle_index >= length) {
       apu_frame_counter_reset_now(apu);
     }
   } else {
-    apu->frame_counter.cycles++;
-
-    if (apu->frame_counter.reset_queued == true) {
-      apu->frame_counter.reset_queue_divider--;
-      if (apu->frame_counter.reset_queue_divider == 0) {
-        apu_frame_counter_reset_now(apu);
-      }
+    // The end of a delayed reset
+    apu_frame_counter_count(apu, 1);
+    if (apu->frame_counter.reset_queued &&
+        apu->frame_counter.reset_queue_divider == 0) {
+      apu_frame_counter_reset_now(apu);
     }
   }
+
+  apu_frame_counter_schedule(apu, apu->cycles + 1);
 }
 
 // ----- OUTPUT -----
@@ -428,7 +504,7 @@ static uint8_t apu_output_pulse(bool enabled, apu_channel_pulse_t* channel) {
   if (channel->duty_cycle_value == 0) return 0;
   if ((*channel->sweep.c_timer_period) > 0x7FF) return 0;
   if (channel->length_counter.length_counter == 0) return 0;
-  if (channel->timer.divider < 8) return 0;
+  if (channel->timer.c_timer_period < 8) return 0;
 
   return apu_unit_envelope_output(&channel->envelope);
 }
@@ -475,11 +551,225 @@ static apu_buffer_t apu_mix(apu_t* apu) {
   return (float)(pulse_out + tnd_out);
 }
 
+// Adds the change of the mixer output since the last call, if any, to the
+// synthesised waveform
+static void apu_update_output(apu_t* apu) {
+  apu_buffer_t output = apu_mix(apu);
+  if (output != apu->output) {
+    blip_add_delta(apu->blip, apu->blip_time, output - apu->output);
+    apu->output = output;
+  }
+}
+
+// ----- EVENTS -----
+// The APU only needs to run cycle by cycle when something happens: a
+// sequencer steps on a channel that can be heard, the frame counter clocks or
+// samples are due. In between, all cycles are skipped at once.
+
+// Whether the output of a channel stays the same, whatever its sequencer
+// does, until the next register write or frame counter clock
+static bool apu_static_pulse(bool enabled, apu_channel_pulse_t* channel) {
+  return !enabled || channel->timer.c_timer_period > 0x7FF ||
+         channel->timer.c_timer_period < 8 ||
+         channel->length_counter.length_counter == 0 ||
+         apu_unit_envelope_output(&channel->envelope) == 0;
+}
+
+static bool apu_static_noise(bool enabled, apu_channel_noise_t* channel) {
+  return !enabled || channel->length_counter.length_counter == 0 ||
+         apu_unit_envelope_output(&channel->envelope) == 0;
+}
+
+static bool apu_static_triangle(bool enabled,
+                                apu_channel_triangle_t* channel) {
+  // Also static when the sequencer does not step
+  return !enabled || channel->length_counter.length_counter == 0 ||
+         channel->linear_counter == 0 || channel->timer.c_timer_period == 0;
+}
+
+// Cycles before the one in which a timer reaches 0, for timers clocked every
+// cycle or every other cycle
+static uint32_t apu_timer_distance(apu_t* apu, apu_unit_timer_t* timer,
+                                   bool every_other) {
+  if (!every_other) {
+    return timer->divider;
+  }
+  return 2 * (uint32_t)timer->divider + (apu->is_even_cycle ? 0 : 1);
+}
+
+// Cycles that can be skipped before the next event
+static uint32_t apu_event_distance(apu_t* apu) {
+  uint32_t distance = APU_BLIP_CYCLES - 1 - apu->blip_time;
+
+  if (apu->frame_counter.event - apu->cycles < distance) {
+    distance = apu->frame_counter.event - apu->cycles;
+  }
+
+#define TIMER_DISTANCE(CHNEL, TYPE, EVERY_OTHER)                              \
+  do {                                                                        \
+    if (!apu_static_##TYPE(apu->previous_status.data.enable_##CHNEL,          \
+                           &apu->channel_##CHNEL)) {                          \
+      uint32_t timer =                                                        \
+          apu_timer_distance(apu, &apu->channel_##CHNEL.timer, EVERY_OTHER); \
+      if (timer < distance) {                                                 \
+        distance = timer;                                                     \
+      }                                                                       \
+    }                                                                         \
+  } while (0)
+  TIMER_DISTANCE(pulse1, pulse, true);
+  TIMER_DISTANCE(pulse2, pulse, true);
+  TIMER_DISTANCE(noise, noise, true);
+  TIMER_DISTANCE(triangle, triangle, false);
+#undef TIMER_DISTANCE
+  return distance;
+}
+
+// Runs cycles with no events at once. Channels that cannot be heard may step.
+static void apu_skip(apu_t* apu, uint32_t cycles) {
+  if (cycles == 0) {
+    return;
+  }
+
+  // Pulse, noise and DMC timers are clocked on even cycles only
+  uint32_t even = (cycles + (apu->is_even_cycle ? 1 : 0)) / 2;
+  uint32_t steps;
+  steps = apu_unit_timer_skip(&apu->channel_pulse1.timer, even);
+  if (steps > 0) {
+    apu_channel_pulse_sequencer_skip(&apu->channel_pulse1, steps);
+  }
+  steps = apu_unit_timer_skip(&apu->channel_pulse2.timer, even);
+  if (steps > 0) {
+    apu_channel_pulse_sequencer_skip(&apu->channel_pulse2, steps);
+  }
+  steps = apu_unit_timer_skip(&apu->channel_noise.timer, even);
+  apu_channel_noise_lfsr_skip(&apu->channel_noise, steps);
+  apu_unit_timer_skip(&apu->channel_dmc.timer, even);
+  steps = apu_unit_timer_skip(&apu->channel_triangle.timer, cycles);
+  if (steps > 0) {
+    apu_channel_triangle_sequencer_skip(&apu->channel_triangle, steps);
+  }
+  apu->is_even_cycle ^= cycles & 1;
+
+  apu_frame_counter_count(apu, cycles);
+  apu->cycles += cycles;
+  apu->blip_time += cycles;
+}
+
 // ----- REST -----
-static void apu_write_to_buffer(apu_t* apu, apu_buffer_t value) {
-  apu->buffer[apu->buffer_cursor] = value;
-  apu->buffer_cursor++;
-  apu->buffer_cursor %= AUDIO_BUFFER_SIZE;
+// Kernel widths of the resampler presets, see apu_quality_t
+static const uint32_t APU_QUALITY_WIDTHS[] = {8, 16, 32};
+
+// Converts a multiple of 8 samples to AF_S16, saturating. All versions round
+// towards zero.
+#if defined(__SSE2__) && !defined(NO_SIMD)
+static void apu_convert_s16(const float* in, int16_t* out, uint32_t count) {
+  __m128 scale = _mm_set1_ps(APU_S16_SCALE);
+  for (uint32_t i = 0; i < count; i += 8) {
+    __m128i lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+    __m128i hi =
+        _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+  }
+}
+#elif defined(__ARM_NEON) && !defined(NO_SIMD)
+static void apu_convert_s16(const float* in, int16_t* out, uint32_t count) {
+  for (uint32_t i = 0; i < count; i += 8) {
+    int32x4_t lo = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(in + i), APU_S16_SCALE));
+    int32x4_t hi =
+        vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(in + i + 4), APU_S16_SCALE));
+    vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+  }
+}
+#else
+static void apu_convert_s16(const float* in, int16_t* out, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    float sample = in[i] * APU_S16_SCALE;
+    if (sample > 32767.0f) {
+      sample = 32767.0f;
+    } else if (sample < -32768.0f) {
+      sample = -32768.0f;
+    }
+    out[i] = (int16_t)sample;
+  }
+}
+#endif
+
+bool apu_configure_output(apu_t* apu, const apu_output_t* config) {
+  blip_t* blip = blip_init(apu->clock_rate, config->rate,
+                           apu_quality_width(config->quality));
+  if (blip == NULL) {
+    return false;
+  }
+  if (apu->blip != NULL) {
+    blip_deinit(apu->blip);
+  }
+  apu->blip = blip;
+  apu->config = *config;
+  apu->blip_time = 0;
+  apu->buffer_cursor = 0;
+  apu->queue_fill = config->queue_target;
+  apu->rate_adjust = 0.0;
+
+  // The new buffer starts at a level of 0
+  apu->output = 0.0f;
+  apu_update_output(apu);
+  return true;
+}
+
+uint32_t apu_quality_width(apu_quality_t quality) {
+  return APU_QUALITY_WIDTHS[quality];
+}
+
+uint32_t apu_sample_size(apu_format_t format) {
+  return format == AF_S16 ? sizeof(int16_t) : sizeof(float);
+}
+
+// Nudges the output rate towards the target fill of the audio queue. The
+// queue fills and drains in whole buffers, so only its average is followed.
+static void apu_rate_control(apu_t* apu, void* context,
+                             apu_get_queue_size_t get_queue_size) {
+  double queued = (double)get_queue_size(context) /
+                  apu_sample_size(apu->config.format);
+  apu->queue_fill += (queued - apu->queue_fill) * APU_RATE_SMOOTHING;
+
+  double target = apu->config.queue_target;
+  double error = (target - apu->queue_fill) / target;
+  if (error > 1.0) {
+    error = 1.0;
+  } else if (error < -1.0) {
+    error = -1.0;
+  }
+  apu->rate_adjust = error * APU_RATE_CONTROL;
+  blip_set_rates(apu->blip, apu->clock_rate,
+                 apu->config.rate * (1.0 + apu->rate_adjust));
+}
+
+static void apu_flush_samples(apu_t* apu, void* context,
+                              apu_enqueue_audio_t enqueue_audio,
+                              apu_get_queue_size_t get_queue_size) {
+  blip_end_frame(apu->blip, apu->blip_time);
+  apu->blip_time = 0;
+
+  while (blip_samples_avail(apu->blip) > 0) {
+    apu->buffer_cursor += blip_read_samples(
+        apu->blip, apu->buffer + apu->buffer_cursor,
+        AUDIO_BUFFER_SIZE - apu->buffer_cursor);
+    if (apu->buffer_cursor == AUDIO_BUFFER_SIZE) {
+      apu->buffer_cursor = 0;
+      if (enqueue_audio == NULL) {
+        continue;
+      }
+      if (apu->config.format == AF_S16) {
+        apu_convert_s16(apu->buffer, apu->buffer_s16, AUDIO_BUFFER_SIZE);
+        enqueue_audio(context, apu->buffer_s16, AUDIO_BUFFER_SIZE);
+      } else {
+        enqueue_audio(context, apu->buffer, AUDIO_BUFFER_SIZE);
+      }
+      if (get_queue_size != NULL && apu->config.queue_target > 0) {
+        apu_rate_control(apu, context, get_queue_size);
+      }
+    }
+  }
 }
 
 void apu_cycle(apu_t* apu, void* context, apu_enqueue_audio_t enqueue_audio,
@@ -488,18 +778,34 @@ void apu_cycle(apu_t* apu, void* context, apu_enqueue_audio_t enqueue_audio,
   apu_timer_clock(apu);
   apu->is_even_cycle = !apu->is_even_cycle;
 
-  // Frame counter
+  // Frame counter, which only does more than count in the cycle of its event
   apu_frame_counter_clock(apu);
+  apu->cycles++;
 
-  // Skip samples / downsample
-  if (apu->sample_skips <= 1.0) {
-    apu_write_to_buffer(apu, apu_mix(apu));
-    if (apu->buffer_cursor == 0) {
-      enqueue_audio(context, apu->buffer, AUDIO_BUFFER_SIZE);
-    }
+  // Synthesise the samples of the cycles so far every now and then, rather
+  // than sampling the mixer output
+  apu->blip_time++;
+  if (apu->blip_time == APU_BLIP_CYCLES) {
+    apu_flush_samples(apu, context, enqueue_audio, get_queue_size);
+  }
+}
 
-    apu->sample_skips += APU_SAMPLE_RATE / APU_ACTUAL_SAMPLE_RATE;
-  } else {
-    apu->sample_skips -= 1.0;
+void apu_run(apu_t* apu, uint32_t cycles, void* context,
+             apu_enqueue_audio_t enqueue_audio,
+             apu_get_queue_size_t get_queue_size) {
+  while (cycles > 0) {
+    uint32_t skip = apu_event_distance(apu);
+    if (skip >= cycles) {
+      apu_skip(apu, cycles);
+      return;
+    }
+    apu_skip(apu, skip);
+    apu_cycle(apu, context, enqueue_audio, get_queue_size);
+    cycles -= skip + 1;
   }
 }
+
+void apu_deinit(apu_t* apu) {
+  blip_deinit(apu->blip);
+  free(apu);
+}
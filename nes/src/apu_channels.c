@@ -44,6 +44,16 @@ void apu_channel_pulse_sequencer_clock(apu_timer_context_t* context) {
                          [channel->current_sequence_position];
 }
 
+// As many pulse sequencer callbacks at once
+void apu_channel_pulse_sequencer_skip(apu_channel_pulse_t* channel,
+                                      uint32_t steps) {
+  channel->current_sequence_position =
+      (channel->current_sequence_position + steps) % DUTY_LENGTH;
+  channel->duty_cycle_value =
+      DUTY_CYCLE_SEQUENCE[channel->c_duty_cycle]
+                         [channel->current_sequence_position];
+}
+
 #define TRIANGLE_LENGTH 32
 static const uint8_t TRIANGLE_CYCLE_SEQUENCE[TRIANGLE_LENGTH] = {
     15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5,  4,  3,  2,  1,  0,
@@ -61,6 +71,17 @@ void apu_channel_triangle_sequencer_clock(apu_timer_context_t* context) {
   }
 }
 
+// As many triangle sequencer callbacks at once, the timer having reloaded
+void apu_channel_triangle_sequencer_skip(apu_channel_triangle_t* channel,
+                                         uint32_t steps) {
+  if (channel->linear_counter > 0 && channel->timer.c_timer_period > 0) {
+    channel->current_sequence_position =
+        (channel->current_sequence_position + steps) % TRIANGLE_LENGTH;
+    channel->duty_cycle_value =
+        TRIANGLE_CYCLE_SEQUENCE[channel->current_sequence_position];
+  }
+}
+
 void apu_channel_triangle_linear_counter_clock(
     apu_channel_triangle_t* channel) {
   if (channel->linear_counter_reload_flag) {
@@ -83,3 +104,10 @@ void apu_channel_noise_lfsr_clock(apu_timer_context_t* context) {
   channel->shift_register >>= 1;
   channel->shift_register |= (bit0 ^ bit_shift) << 14;
 }
+
+// As many noise shift register callbacks at once
+void apu_channel_noise_lfsr_skip(apu_channel_noise_t* channel, uint32_t steps) {
+  for (uint32_t i = 0; i < steps; i++) {
+    apu_channel_noise_lfsr_clock(channel);
+  }
+}
@@ -85,16 +85,30 @@ void apu_unit_sweep_clock(apu_unit_sweep_t* unit, bool ones_complement) {
 }
 
 /* https://wiki.nesdev.com/w/index.php/APU#Glossary */
-void apu_unit_timer_clock(apu_unit_timer_t* unit, apu_timer_context_t* context,
+bool apu_unit_timer_clock(apu_unit_timer_t* unit, apu_timer_context_t* context,
                           apu_timer_clock_t on_clock) {
   if (unit->divider == 0) {
     unit->divider = unit->c_timer_period;
     if (context != NULL && on_clock != NULL) {
       on_clock(context);
     }
-  } else {
-    unit->divider--;
+    return true;
+  }
+  unit->divider--;
+  return false;
+}
+
+uint32_t apu_unit_timer_skip(apu_unit_timer_t* unit, uint32_t clocks) {
+  if (clocks <= unit->divider) {
+    unit->divider -= clocks;
+    return 0;
   }
+
+  // The first reload, then one every period
+  clocks -= unit->divider + 1;
+  uint32_t period = unit->c_timer_period + 1;
+  unit->divider = unit->c_timer_period - clocks % period;
+  return 1 + clocks / period;
 }
 
 static const int LENGTH_COUNTER_LOAD_TABLE[] = {
@@ -0,0 +1,183 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(NO_SIMD)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && !defined(NO_SIMD)
+#include <arm_neon.h>
+#endif
+
+#include "blip.h"
+
+/**
+ * blip.c
+ */
+
+// Cutoff of the steps, as a fraction of the output sample rate. Just below
+// the Nyquist frequency, so that the band is not too wide for the kernel.
+#define BLIP_CUTOFF 0.45
+
+#define BLIP_PI 3.14159265358979323846
+
+// Cutoff of the high-pass filter leaking the integrator, in Hz
+#define BLIP_BASS_HZ 14.0
+
+/**
+ * Helper functions
+ *
+ * blip_kernel_init
+ *   Fills in the band-limited step of every phase, as a Blackman windowed sinc
+ *   normalised to sum to 1.
+ *
+ * blip_accumulate
+ *   Adds a kernel scaled by a delta to the buffer, 8 samples at a time, with
+ *   SSE2 or NEON where available. Building with NO_SIMD selects the scalar
+ *   version.
+ */
+static void blip_kernel_init(blip_t* blip) {
+  double width = blip->width;
+  for (int phase = 0; phase < BLIP_PHASES; phase++) {
+    double sum = 0.0;
+    double kernel[BLIP_MAX_WIDTH];
+    for (uint32_t i = 0; i < blip->width; i++) {
+      double t = i - (width / 2 - 1) - (double)phase / BLIP_PHASES;
+      double x = 2.0 * BLIP_CUTOFF * t;
+      double sinc = x == 0.0 ? 1.0 : sin(BLIP_PI * x) / (BLIP_PI * x);
+      double window = 0.42 + 0.5 * cos(2.0 * BLIP_PI * t / width) +
+                      0.08 * cos(4.0 * BLIP_PI * t / width);
+      kernel[i] = sinc * window;
+      sum += kernel[i];
+    }
+    for (uint32_t i = 0; i < blip->width; i++) {
+      blip->kernel[phase][i] = (float)(kernel[i] / sum);
+    }
+  }
+}
+
+#if defined(__SSE2__) && !defined(NO_SIMD)
+static void blip_accumulate(float* out, const float* kernel, float delta,
+                            uint32_t width) {
+  __m128 d = _mm_set1_ps(delta);
+  for (uint32_t i = 0; i < width; i += 8) {
+    __m128 lo = _mm_mul_ps(_mm_loadu_ps(kernel + i), d);
+    __m128 hi = _mm_mul_ps(_mm_loadu_ps(kernel + i + 4), d);
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), lo));
+    _mm_storeu_ps(out + i + 4, _mm_add_ps(_mm_loadu_ps(out + i + 4), hi));
+  }
+}
+#elif defined(__ARM_NEON) && !defined(NO_SIMD)
+static void blip_accumulate(float* out, const float* kernel, float delta,
+                            uint32_t width) {
+  // Not fused, which would round differently from the other versions
+  for (uint32_t i = 0; i < width; i += 8) {
+    float32x4_t lo = vmulq_n_f32(vld1q_f32(kernel + i), delta);
+    float32x4_t hi = vmulq_n_f32(vld1q_f32(kernel + i + 4), delta);
+    vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), lo));
+    vst1q_f32(out + i + 4, vaddq_f32(vld1q_f32(out + i + 4), hi));
+  }
+}
+#else
+static void blip_accumulate(float* out, const float* kernel, float delta,
+                            uint32_t width) {
+  for (uint32_t i = 0; i < width; i++) {
+    out[i] += delta * kernel[i];
+  }
+}
+#endif
+
+/**
+ * Public functions
+ *
+ * See blip.h for descriptions.
+ */
+blip_t* blip_init(double clock_rate, double sample_rate, uint32_t width) {
+  blip_t* blip = calloc(1, sizeof(blip_t));
+  if (blip == NULL) {
+    return NULL;
+  }
+  blip->width = width;
+  blip_set_rates(blip, clock_rate, sample_rate);
+  blip_kernel_init(blip);
+  return blip;
+}
+
+void blip_set_rates(blip_t* blip, double clock_rate, double sample_rate) {
+  blip->factor =
+      (uint64_t)(sample_rate / clock_rate * (double)(1ULL << BLIP_FRAC_BITS) +
+                 0.5);
+  // The leak is per sample, so it follows the output rate to keep the cutoff
+  blip->bass = 1.0 - exp(-2.0 * BLIP_PI * BLIP_BASS_HZ / sample_rate);
+}
+
+void blip_add_delta(blip_t* blip, uint32_t time, float delta) {
+  uint64_t position = blip->offset + time * blip->factor;
+  uint32_t index = position >> BLIP_FRAC_BITS;
+  uint32_t phase =
+      (position >> (BLIP_FRAC_BITS - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1);
+  blip_accumulate(blip->buffer + index, blip->kernel[phase], delta,
+                  blip->width);
+}
+
+void blip_end_frame(blip_t* blip, uint32_t time) {
+  blip->offset += time * blip->factor;
+}
+
+uint32_t blip_clocks_max(blip_t* blip) {
+  uint64_t limit = (uint64_t)BLIP_MAX_SAMPLES << BLIP_FRAC_BITS;
+  return (limit - blip->offset - 1) / blip->factor;
+}
+
+uint32_t blip_samples_avail(blip_t* blip) {
+  return blip->offset >> BLIP_FRAC_BITS;
+}
+
+uint32_t blip_read_samples(blip_t* blip, float* out, uint32_t count) {
+  uint32_t avail = blip_samples_avail(blip);
+  if (count > avail) {
+    count = avail;
+  }
+
+  float integrator = blip->integrator;
+  float bass = blip->bass;
+  for (uint32_t i = 0; i < count; i++) {
+    integrator += blip->buffer[i];
+    out[i] = integrator;
+    integrator -= integrator * bass;
+  }
+  blip->integrator = integrator;
+
+  // Steps reach at most the width past the end of the frame
+  uint32_t remaining = avail - count + blip->width;
+  memmove(blip->buffer, blip->buffer + count, remaining * sizeof(float));
+  memset(blip->buffer + remaining, 0, count * sizeof(float));
+  blip->offset -= (uint64_t)count << BLIP_FRAC_BITS;
+  return count;
+}
+
+void blip_deinit(blip_t* blip) { free(blip); }
@@ -61,7 +61,9 @@ static void controller_pulse(void) {
 /**
  * Public functions
  */
-int controller_nes_init(void) {
+int controller_nes_init(void** data) {
+  // The GPIO pins are shared, so there is no per-instance state
+  *data = NULL;
 // TODO: This may need further modification to trigger on sigint.
 #ifdef IS_PI
   if (gpioInitialise() < 0) {
@@ -77,7 +79,7 @@ int controller_nes_init(void) {
   return EXIT_SUCCESS;
 }
 
-void controller_nes_poll(controller_t* ctrl) {
+void controller_nes_poll(void* data, controller_t* ctrl) {
 #ifdef IS_PI
   // Set latch for 12us
   gpioWrite(PIN_LATCH, 1);
@@ -133,7 +135,7 @@ void controller_nes_poll(controller_t* ctrl) {
 #endif
 }
 
-void controller_nes_deinit(void) {
+void controller_nes_deinit(void* data) {
 #ifdef IS_PI
   gpioTerminate();
 #endif
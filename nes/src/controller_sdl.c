@@ -23,7 +23,10 @@
  * SOFTWARE.
  */
 
+#ifndef HEADLESS
 #include <SDL.h>
+#endif
+#include <stdlib.h>
 
 #include "controller.h"
 #include "controller_sdl.h"
@@ -37,85 +40,82 @@
  * The internal SDL controller state, updated on SDL events. This gets
  * merged into the system controller on polls.
  */
-static controller_pressed_t ctrl1_state;
-static controller_pressed_t ctrl2_state;
+typedef struct {
+  controller_pressed_t ctrl1_state;
+  controller_pressed_t ctrl2_state;
+} controller_sdl_t;
 
 /**
  * Public functions
  */
-void controller_sdl_button(SDL_Event event) {
+#ifndef HEADLESS
+void controller_sdl_button(controller_t* ctrl, SDL_Event event) {
+  controller_sdl_t* sdl = ctrl->drivers[CONTROLLER_DRIVER_SDL];
+  if (sdl == NULL) {
+    return;
+  }
   uint8_t v = (event.key.state == SDL_PRESSED ? 1 : 0);
   switch (event.key.keysym.sym) {
     case SDLK_k:
-      ctrl1_state.a = v;
+      sdl->ctrl1_state.a = v;
       break;
     case SDLK_j:
-      ctrl1_state.b = v;
+      sdl->ctrl1_state.b = v;
       break;
     case SDLK_BACKSPACE:
-      ctrl1_state.select = v;
+      sdl->ctrl1_state.select = v;
       break;
     case SDLK_RETURN:
-      ctrl1_state.start = v;
+      sdl->ctrl1_state.start = v;
       break;
     case SDLK_UP:  // pass through
     case SDLK_w:
-      ctrl1_state.up = v;
+      sdl->ctrl1_state.up = v;
       break;
     case SDLK_DOWN:  // pass through
     case SDLK_s:
-      ctrl1_state.down = v;
+      sdl->ctrl1_state.down = v;
       break;
     case SDLK_LEFT:  // pass through
     case SDLK_a:
-      ctrl1_state.left = v;
+      sdl->ctrl1_state.left = v;
       break;
     case SDLK_RIGHT:  // pass through
     case SDLK_d:
-      ctrl1_state.right = v;
+      sdl->ctrl1_state.right = v;
       break;
   }
 }
+#endif
 
-int controller_sdl_init(void) {
-  ctrl1_state.a = 0;
-  ctrl1_state.b = 0;
-  ctrl1_state.select = 0;
-  ctrl1_state.start = 0;
-  ctrl1_state.up = 0;
-  ctrl1_state.down = 0;
-  ctrl1_state.left = 0;
-  ctrl1_state.right = 0;
-  ctrl2_state.a = 0;
-  ctrl2_state.b = 0;
-  ctrl2_state.select = 0;
-  ctrl2_state.start = 0;
-  ctrl2_state.up = 0;
-  ctrl2_state.down = 0;
-  ctrl2_state.left = 0;
-  ctrl2_state.right = 0;
-  return EC_SUCCESS;
+int controller_sdl_init(void** data) {
+  // All buttons start released
+  *data = calloc(1, sizeof(controller_sdl_t));
+  return *data != NULL ? EC_SUCCESS : EC_ERROR;
 }
 
-void controller_sdl_poll(controller_t* ctrl) {
-  ctrl->pressed1.a |= ctrl1_state.a;
-  ctrl->pressed1.b |= ctrl1_state.b;
-  ctrl->pressed1.select |= ctrl1_state.select;
-  ctrl->pressed1.start |= ctrl1_state.start;
-  ctrl->pressed1.up |= ctrl1_state.up;
-  ctrl->pressed1.down |= ctrl1_state.down;
-  ctrl->pressed1.left |= ctrl1_state.left;
-  ctrl->pressed1.right |= ctrl1_state.right;
-  ctrl->pressed2.a |= ctrl2_state.a;
-  ctrl->pressed2.b |= ctrl2_state.b;
-  ctrl->pressed2.select |= ctrl2_state.select;
-  ctrl->pressed2.start |= ctrl2_state.start;
-  ctrl->pressed2.up |= ctrl2_state.up;
-  ctrl->pressed2.down |= ctrl2_state.down;
-  ctrl->pressed2.left |= ctrl2_state.left;
-  ctrl->pressed2.right |= ctrl2_state.right;
+void controller_sdl_poll(void* data, controller_t* ctrl) {
+  controller_sdl_t* sdl = (controller_sdl_t*)data;
+  // Nothing is pressed if the state could not be allocated
+  if (sdl == NULL) {
+    return;
+  }
+  ctrl->pressed1.a |= sdl->ctrl1_state.a;
+  ctrl->pressed1.b |= sdl->ctrl1_state.b;
+  ctrl->pressed1.select |= sdl->ctrl1_state.select;
+  ctrl->pressed1.start |= sdl->ctrl1_state.start;
+  ctrl->pressed1.up |= sdl->ctrl1_state.up;
+  ctrl->pressed1.down |= sdl->ctrl1_state.down;
+  ctrl->pressed1.left |= sdl->ctrl1_state.left;
+  ctrl->pressed1.right |= sdl->ctrl1_state.right;
+  ctrl->pressed2.a |= sdl->ctrl2_state.a;
+  ctrl->pressed2.b |= sdl->ctrl2_state.b;
+  ctrl->pressed2.select |= sdl->ctrl2_state.select;
+  ctrl->pressed2.start |= sdl->ctrl2_state.start;
+  ctrl->pressed2.up |= sdl->ctrl2_state.up;
+  ctrl->pressed2.down |= sdl->ctrl2_state.down;
+  ctrl->pressed2.left |= sdl->ctrl2_state.left;
+  ctrl->pressed2.right |= sdl->ctrl2_state.right;
 }
 
-void controller_sdl_deinit(void) {
-  // Do nothing
-}
+void controller_sdl_deinit(void* data) { free(data); }
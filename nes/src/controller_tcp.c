@@ -45,13 +45,16 @@
 
 #define READLEN 1000
 
-static union {
+typedef union {
   controller_pressed_t state;
   uint8_t raw;
-} ctrl_1, ctrl_2;
+} controller_tcp_state_t;
 
-static struct {
-  int sockfd;        // socket file descriptor
+typedef struct {
+  controller_tcp_state_t ctrl_1;
+  controller_tcp_state_t ctrl_2;
+
+  int sockfd;        // socket file descriptor, -1 if not listening
   int newsockfd;     // socket file descriptor upon succesful client/sever
                      // connection
   int portno;        // port number on which server accepts connections from
@@ -59,78 +62,107 @@ static struct {
   socklen_t clilen;  // size of address of client
   struct sockaddr_in serv_addr;
   struct sockaddr_in cli_addr;
-} tcp;
 
-static bool has_client = false;
-static uint8_t buffer[READLEN];  // Zeroed out as part of BSS.
+  bool has_client;
+  uint8_t buffer[READLEN];
+} controller_tcp_t;
+
+/**
+ * Private functions
+ *
+ * controller_tcp_fail
+ *   Prints the error and stops listening, so that polls do nothing.
+ */
+static int controller_tcp_fail(controller_tcp_t* tcp, const char* message) {
+  perror(message);
+  if (tcp->sockfd >= 0) {
+    close(tcp->sockfd);
+    tcp->sockfd = -1;
+  }
+  return 1;
+}
+
+/**
+ * Public functions
+ */
+int controller_tcp_init(void** data) {
+  controller_tcp_t* tcp = calloc(1, sizeof(controller_tcp_t));
+  *data = tcp;
+  tcp->newsockfd = -1;
 
-int controller_tcp_init(void) {
   // Initialise socket
-  tcp.sockfd = socket(AF_INET, SOCK_STREAM, 0);
-  if (tcp.sockfd < 0) {
-    perror("ERROR on opening socket");
-    return 1;
+  tcp->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (tcp->sockfd < 0) {
+    return controller_tcp_fail(tcp, "ERROR on opening socket");
   }
   // Set socket to non-blocking
   int status =
-      fcntl(tcp.sockfd, F_SETFL, fcntl(tcp.sockfd, F_GETFL, 0) | O_NONBLOCK);
+      fcntl(tcp->sockfd, F_SETFL, fcntl(tcp->sockfd, F_GETFL, 0) | O_NONBLOCK);
   if (status < 0) {
-    perror("ERROR on fcntl");
-    return 1;
+    return controller_tcp_fail(tcp, "ERROR on fcntl");
   }
   // Initialise server address
-  memset((char*)&tcp.serv_addr, '\0', sizeof(tcp.serv_addr));
-  tcp.serv_addr.sin_family = AF_INET;
-  tcp.serv_addr.sin_addr.s_addr = INADDR_ANY;
-  tcp.serv_addr.sin_port = htons(PORT_NO);
+  memset((char*)&tcp->serv_addr, '\0', sizeof(tcp->serv_addr));
+  tcp->serv_addr.sin_family = AF_INET;
+  tcp->serv_addr.sin_addr.s_addr = INADDR_ANY;
+  tcp->serv_addr.sin_port = htons(PORT_NO);
   // Bind socket to address
-  if (bind(tcp.sockfd, (struct sockaddr*)&tcp.serv_addr,
-           sizeof(tcp.serv_addr)) < 0) {
-    perror("ERROR on binding");
-    return 1;
+  if (bind(tcp->sockfd, (struct sockaddr*)&tcp->serv_addr,
+           sizeof(tcp->serv_addr)) < 0) {
+    return controller_tcp_fail(tcp, "ERROR on binding");
   }
-  listen(tcp.sockfd, 5);
-  tcp.clilen = sizeof(tcp.cli_addr);
+  listen(tcp->sockfd, 5);
+  tcp->clilen = sizeof(tcp->cli_addr);
   return 0;
 }
 
-void controller_tcp_poll(controller_t* ctrl) {
+void controller_tcp_poll(void* data, controller_t* ctrl) {
+  controller_tcp_t* tcp = (controller_tcp_t*)data;
   int n;  // return value for read() and write()
-  if (!has_client) {
-    tcp.newsockfd =
-        accept(tcp.sockfd, (struct sockaddr*)&tcp.cli_addr, &tcp.clilen);
-    if (tcp.newsockfd < 0) {
+  if (tcp->sockfd < 0) {
+    return;
+  }
+  if (!tcp->has_client) {
+    tcp->newsockfd =
+        accept(tcp->sockfd, (struct sockaddr*)&tcp->cli_addr, &tcp->clilen);
+    if (tcp->newsockfd < 0) {
       //  perror("ERROR on accept");
       return;
     }
     // Connection established with client
-    has_client = true;
+    tcp->has_client = true;
   }
-  n = read(tcp.newsockfd, buffer, READLEN);
+  n = read(tcp->newsockfd, tcp->buffer, READLEN);
   if (n >= 2) {
-    ctrl_1.raw = buffer[0];
-    ctrl_2.raw = buffer[1];
+    tcp->ctrl_1.raw = tcp->buffer[0];
+    tcp->ctrl_2.raw = tcp->buffer[1];
   }
 
-  ctrl->pressed1.a |= ctrl_1.state.a;
-  ctrl->pressed1.b |= ctrl_1.state.b;
-  ctrl->pressed1.select |= ctrl_1.state.select;
-  ctrl->pressed1.start |= ctrl_1.state.start;
-  ctrl->pressed1.up |= ctrl_1.state.up;
-  ctrl->pressed1.down |= ctrl_1.state.down;
-  ctrl->pressed1.left |= ctrl_1.state.left;
-  ctrl->pressed1.right |= ctrl_1.state.right;
-  ctrl->pressed2.a |= ctrl_2.state.a;
-  ctrl->pressed2.b |= ctrl_2.state.b;
-  ctrl->pressed2.select |= ctrl_2.state.select;
-  ctrl->pressed2.start |= ctrl_2.state.start;
-  ctrl->pressed2.up |= ctrl_2.state.up;
-  ctrl->pressed2.down |= ctrl_2.state.down;
-  ctrl->pressed2.left |= ctrl_2.state.left;
-  ctrl->pressed2.right |= ctrl_2.state.right;
+  ctrl->pressed1.a |= tcp->ctrl_1.state.a;
+  ctrl->pressed1.b |= tcp->ctrl_1.state.b;
+  ctrl->pressed1.select |= tcp->ctrl_1.state.select;
+  ctrl->pressed1.start |= tcp->ctrl_1.state.start;
+  ctrl->pressed1.up |= tcp->ctrl_1.state.up;
+  ctrl->pressed1.down |= tcp->ctrl_1.state.down;
+  ctrl->pressed1.left |= tcp->ctrl_1.state.left;
+  ctrl->pressed1.right |= tcp->ctrl_1.state.right;
+  ctrl->pressed2.a |= tcp->ctrl_2.state.a;
+  ctrl->pressed2.b |= tcp->ctrl_2.state.b;
+  ctrl->pressed2.select |= tcp->ctrl_2.state.select;
+  ctrl->pressed2.start |= tcp->ctrl_2.state.start;
+  ctrl->pressed2.up |= tcp->ctrl_2.state.up;
+  ctrl->pressed2.down |= tcp->ctrl_2.state.down;
+  ctrl->pressed2.left |= tcp->ctrl_2.state.left;
+  ctrl->pressed2.right |= tcp->ctrl_2.state.right;
 }
 
-void controller_tcp_deinit(void) {
-  close(tcp.newsockfd);
-  close(tcp.sockfd);
+void controller_tcp_deinit(void* data) {
+  controller_tcp_t* tcp = (controller_tcp_t*)data;
+  if (tcp->newsockfd >= 0) {
+    close(tcp->newsockfd);
+  }
+  if (tcp->sockfd >= 0) {
+    close(tcp->sockfd);
+  }
+  free(tcp);
 }
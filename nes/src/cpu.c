@@ -25,6 +25,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "cpu.h"
 #include "rom.h"
@@ -36,6 +37,17 @@
 #define IV_RESET 0xFFFC
 #define IV_IRQ_BRK 0xFFFE
 
+#define JIT_PAGE(A) ((uint8_t)((A) >> 8))
+#define JIT_RAM_UPPER 0x2000
+#define JIT_SRAM_BASE 0x6000
+#define JIT_ROM_BASE 0x8000
+
+// The threaded handlers fetch straight from memory, so decoded blocks would
+// never be executed, only invalidated on every write
+#if defined(THREADED_DISPATCH) && !defined(NO_BLOCK_CACHE)
+#error "THREADED_DISPATCH replaces the block cache, define NO_BLOCK_CACHE"
+#endif
+
 /**
  * Memory access functions
  */
@@ -44,12 +56,29 @@ static bool is_page_crossed(uint16_t address1, uint16_t address2) {
 }
 
 static uint8_t cpu_mem_read8(cpu_t* cpu, uint16_t address) {
+  // Plain memory is read straight from the page table
+  uint8_t* host = cpu->mapper->pages[MMAP_PAGE(address)].read;
+  if (host != NULL) {
+    return host[MMAP_OFFSET(address)];
+  }
   return mmap_cpu_read(cpu->mapper, address, false);
   // return cpu->memory[address];
 }
 
+#ifndef NO_BLOCK_CACHE
+static void jit_invalidate(cpu_t* cpu, uint16_t address);
+#endif
+
 static void cpu_mem_write8(cpu_t* cpu, uint16_t address, uint8_t value) {
-  mmap_cpu_write(cpu->mapper, address, value);
+  uint8_t* host = cpu->mapper->pages[MMAP_PAGE(address)].write;
+  if (host != NULL) {
+    host[MMAP_OFFSET(address)] = value;
+  } else {
+    mmap_cpu_write(cpu->mapper, address, value);
+  }
+#ifndef NO_BLOCK_CACHE
+  jit_invalidate(cpu, address);
+#endif
   // cpu->memory[address] = value;
 }
 
@@ -127,6 +156,10 @@ void cpu_interrupt(cpu_t* cpu, interrupt_type_t type) {
  */
 void perform_irq(cpu_t* cpu);
 void perform_nmi(cpu_t* cpu);
+#ifdef THREADED_DISPATCH
+static bool cpu_dispatch(cpu_t* cpu, uint64_t* cycles, uint64_t end,
+                         const uint64_t* deadline);
+#endif
 
 void instr_address(cpu_t* cpu, instruction_t instr, uint16_t pc,
                    uint8_t* bytes_used, uint16_t* address, bool* page_crossed,
@@ -210,40 +243,256 @@ void instr_address(cpu_t* cpu, instruction_t instr, uint16_t pc,
   }
 }
 
-void jit_one(cpu_t* cpu, uint16_t pc) {
-  uint8_t opcode = cpu_mem_read8(cpu, pc);
-  instruction_t instr = INSTRUCTION_VECTOR[opcode];
-  uint8_t bytes_used = 0;
-  uint16_t address = 0;
-  bool page_crossed = false;
-  bool requires_state = false;
-  instr_address(cpu, instr, pc, &bytes_used, &address, &page_crossed,
-                &requires_state);
-  if (!requires_state && instr.implementation != NULL) {
-    cpu->compiled[pc] = (jit_instruction_t){
-        .compiled = false,
-        .execute = instr.implementation,
-        .address = address,
-        .cycles = instr.cycles + (instr.cycle_cross && page_crossed ? 1 : 0),
-        .size = bytes_used};
+#ifndef NO_BLOCK_CACHE
+/**
+ * JIT functions
+ *
+ * jit_decode
+ *   Decodes the instruction at the given address straight from the host
+ *   memory backing it, without going through the memory map. Instructions
+ *   crossing into the next page are left with no execute, ending the block.
+ *
+ * jit_address
+ *   Resolves the effective address of a decoded instruction whose address
+ *   depends on the CPU state.
+ *
+ * jit_block_slot
+ *   Returns the cache slot for a block starting at the given address. Blocks
+ *   in PRG ROM are cached per bank on the mapper, so they survive resets and
+ *   bank switches; blocks in writable memory are cached per address.
+ *
+ * jit_block_build
+ *   Decodes a run of instructions into a block, ending at the next change of
+ *   control flow.
+ *
+ * jit_fetch
+ *   Returns the next instruction to execute from the block cache, or NULL if
+ *   the instruction at PC cannot be executed from a block.
+ *
+ * jit_invalidate
+ *   Invalidates blocks affected by a CPU write.
+ */
+void cpu_impl_brk(cpu_t* cpu, uint16_t address);
+void cpu_impl_jmp(cpu_t* cpu, uint16_t address);
+void cpu_impl_jsr(cpu_t* cpu, uint16_t address);
+void cpu_impl_rti(cpu_t* cpu, uint16_t address);
+void cpu_impl_rts(cpu_t* cpu, uint16_t address);
+
+static const uint8_t JIT_MODE_SIZES[] = {
+    [AM_ACCUMULATOR] = 1, [AM_IMPLIED] = 1,         [AM_IMMEDIATE] = 2,
+    [AM_ABSOLUTE] = 3,    [AM_ZERO_PAGE] = 2,       [AM_RELATIVE] = 2,
+    [AM_ABSOLUTE_X] = 3,  [AM_ABSOLUTE_Y] = 3,      [AM_ZERO_PAGE_X] = 2,
+    [AM_ZERO_PAGE_Y] = 2, [AM_ZERO_PAGE_INDIRECT] = 2,
+    [AM_ZERO_PAGE_INDIRECT_Y] = 2, [AM_INDIRECT] = 3};
+
+static void jit_decode(uint16_t pc, const uint8_t* source,
+                       jit_instruction_t* jit) {
+  instruction_t instr = INSTRUCTION_VECTOR[source[0]];
+  uint8_t size = JIT_MODE_SIZES[instr.mode];
+  // The operand bytes are only contiguous in host memory within the page
+  if (JIT_PAGE(pc + size - 1) != JIT_PAGE(pc)) {
+    *jit = (jit_instruction_t){.execute = NULL, .size = 0};
+    return;
+  }
+  uint16_t operand = 0;
+  if (size == 2) {
+    operand = source[1];
+  } else if (size == 3) {
+    operand = source[1] | ((uint16_t)source[2] << 8);
+  }
+
+  uint16_t address = operand;
+  bool indexed = false;
+  switch (instr.mode) {
+    case AM_ACCUMULATOR:
+    case AM_IMPLIED:
+      address = 0;
+      break;
+    case AM_IMMEDIATE:
+      address = pc + 1;
+      break;
+    case AM_RELATIVE:
+      // Signed offset from the next instruction, see instr_address
+      if (operand < 0x80) {
+        address = pc + 2 + operand;
+      } else {
+        address = pc + 2 + operand - 0x100;
+      }
+      break;
+    case AM_ABSOLUTE:
+    case AM_ZERO_PAGE:
+      break;
+    default:
+      // The indirect pointer may be in RAM, so it is also resolved when
+      // executed
+      indexed = true;
+      break;
+  }
+
+  *jit = (jit_instruction_t){.execute = instr.implementation,
+                             .address = address,
+                             .mode = instr.mode,
+                             .cycles = instr.cycles,
+                             .size = size,
+                             .indexed = indexed,
+                             .cycle_cross = instr.cycle_cross};
+}
+
+static uint16_t jit_address(cpu_t* cpu, const jit_instruction_t* jit,
+                            bool* page_crossed) {
+  uint16_t address = jit->address;
+  switch (jit->mode) {
+    case AM_ABSOLUTE_X:
+      *page_crossed = is_page_crossed(address, address + cpu->register_x);
+      return address + cpu->register_x;
+    case AM_ABSOLUTE_Y:
+      *page_crossed = is_page_crossed(address, address + cpu->register_y);
+      return address + cpu->register_y;
+    case AM_ZERO_PAGE_X:
+      return (address + cpu->register_x) & 0xFF;
+    case AM_ZERO_PAGE_Y:
+      return (address + cpu->register_y) & 0xFF;
+    case AM_ZERO_PAGE_INDIRECT:
+      return cpu_mem_read16_bug(cpu, (address + cpu->register_x) & 0xFF);
+    case AM_ZERO_PAGE_INDIRECT_Y:
+      address = cpu_mem_read16_bug(cpu, address);
+      *page_crossed = is_page_crossed(address, address + cpu->register_y);
+      return address + cpu->register_y;
+    case AM_INDIRECT:
+      return cpu_mem_read16_bug(cpu, address);
+    default:
+      return address;
+  }
+}
+
+static bool jit_ends_block(const jit_instruction_t* jit) {
+  return jit->mode == AM_RELATIVE || jit->execute == &cpu_impl_brk ||
+         jit->execute == &cpu_impl_jmp || jit->execute == &cpu_impl_jsr ||
+         jit->execute == &cpu_impl_rti || jit->execute == &cpu_impl_rts;
+}
+
+static jit_block_t** jit_block_slot(cpu_t* cpu, uint16_t pc,
+                                    const uint8_t* source) {
+  mapper_t* mapper = cpu->mapper;
+  uint8_t* prg_rom = mapper->memory->prg_rom;
+  size_t prg_rom_size = rom_get_prg_rom_size(mapper);
+  if (source >= prg_rom && source < prg_rom + prg_rom_size) {
+    if (mapper->jit_blocks == NULL) {
+      mapper->jit_blocks = calloc(prg_rom_size, sizeof(jit_block_t*));
+    }
+    return &mapper->jit_blocks[source - prg_rom];
+  }
+  return &cpu->blocks[pc];
+}
+
+static jit_block_t* jit_block_build(cpu_t* cpu, jit_block_t** slot,
+                                    uint16_t pc, const uint8_t* source) {
+  jit_instruction_t code[JIT_BLOCK_SIZE];
+  uint8_t length = 0;
+  uint16_t at = pc;
+  while (length < JIT_BLOCK_SIZE) {
+    // Blocks stay within one page, which is contiguous in host memory and
+    // lets writes be tracked per page
+    if (JIT_PAGE(at) != JIT_PAGE(pc)) {
+      break;
+    }
+    jit_instruction_t* jit = &code[length];
+    jit_decode(at, source + (at - pc), jit);
+    if (jit->execute == NULL) {
+      break;
+    }
+    length++;
+    at += jit->size;
+    if (jit_ends_block(jit)) {
+      break;
+    }
+  }
+
+  jit_block_t* block =
+      realloc(*slot, sizeof(jit_block_t) + length * sizeof(jit_instruction_t));
+  block->source = source;
+  block->pc = pc;
+  block->length = length;
+  memcpy(block->code, code, length * sizeof(jit_instruction_t));
+  *slot = block;
+  if (pc < JIT_ROM_BASE) {
+    cpu->jit_pages[JIT_PAGE(pc)] = true;
+  }
+  return block;
+}
+
+static jit_instruction_t* jit_fetch(cpu_t* cpu) {
+  uint16_t pc = cpu->program_counter;
+  jit_block_t* block = cpu->block;
+  if (block == NULL || cpu->block_pc != pc ||
+      cpu->block_index >= block->length) {
+    const uint8_t* source = mmap_cpu_host(cpu->mapper, pc);
+    if (source == NULL) {
+      cpu->block = NULL;
+      return NULL;
+    }
+    jit_block_t** slot = jit_block_slot(cpu, pc, source);
+    block = *slot;
+    if (block == NULL || block->source != source || block->pc != pc) {
+      block = jit_block_build(cpu, slot, pc, source);
+    }
+    if (block->length == 0) {
+      cpu->block = NULL;
+      return NULL;
+    }
+    cpu->block = block;
+    cpu->block_index = 0;
+  }
+  return &block->code[cpu->block_index++];
+}
+
+static void jit_invalidate_page(cpu_t* cpu, uint8_t page) {
+  if (!cpu->jit_pages[page]) {
+    return;
+  }
+  cpu->jit_pages[page] = false;
+
+  uint16_t base = ((uint16_t)page) << 8;
+  for (uint16_t i = 0; i < 0x100; i++) {
+    if (cpu->blocks[base + i] != NULL) {
+      cpu->blocks[base + i]->source = NULL;
+    }
+  }
+  if (cpu->block != NULL && JIT_PAGE(cpu->block->pc) == page) {
+    cpu->block = NULL;
+  }
+}
+
+static void jit_invalidate(cpu_t* cpu, uint16_t address) {
+  if (address < JIT_RAM_UPPER) {
+    // Work RAM is mirrored
+    for (uint16_t mirror = address % WORK_RAM_SIZE; mirror < JIT_RAM_UPPER;
+         mirror += WORK_RAM_SIZE) {
+      jit_invalidate_page(cpu, JIT_PAGE(mirror));
+    }
+  } else if (address >= JIT_SRAM_BASE && address < JIT_ROM_BASE) {
+    jit_invalidate_page(cpu, JIT_PAGE(address));
+  } else if (address >= JIT_ROM_BASE) {
+    // Mapper register, banks may have been switched under the current block
+    cpu->block = NULL;
   }
 }
+#endif
 
-void jit_all(cpu_t* cpu) {
+void cpu_jit_flush(cpu_t* cpu) {
   for (int i = 0; i < MEMORY_SIZE; i++) {
-    jit_one(cpu, i);
+    if (cpu->blocks[i] != NULL) {
+      cpu->blocks[i]->source = NULL;
+    }
   }
+  memset(cpu->jit_pages, 0, sizeof(cpu->jit_pages));
+  cpu->block = NULL;
 }
 
 cpu_t* cpu_init() {
   cpu_t* cpu = calloc(1, sizeof(cpu_t));
   // ret->memory = malloc(sizeof(uint8_t) * MEMORY_SIZE);
-  cpu->compiled = calloc(MEMORY_SIZE, sizeof(jit_instruction_t));
-  /*
-  for (int i = 0; i < MEMORY_SIZE; i++) {
-    cpu->compiled[i] = (jit_instruction_t){.compiled = false};
-  }
-  */
+  cpu->blocks = calloc(MEMORY_SIZE, sizeof(jit_block_t*));
   return cpu;
 }
 
@@ -265,8 +514,9 @@ void cpu_reset(cpu_t* cpu) {
   cpu->nmi_detected = false;
   cpu->nmi_pending = false;
 
-  // Precompile instructions
-  jit_all(cpu);
+  // Instructions are decoded on demand, and decoded blocks stay valid across
+  // resets
+  cpu->block = NULL;
 
   // Reset on power on (not done for tests)
   cpu_interrupt(cpu, INTRT_RESET);
@@ -274,7 +524,10 @@ void cpu_reset(cpu_t* cpu) {
 
 void cpu_deinit(cpu_t* cpu) {
   // free(cpu->memory);
-  free(cpu->compiled);
+  for (int i = 0; i < MEMORY_SIZE; i++) {
+    free(cpu->blocks[i]);
+  }
+  free(cpu->blocks);
   free(cpu);
 }
 
@@ -308,20 +561,39 @@ bool cpu_cycle(cpu_t* cpu) {
       break;
   }
 
+#ifdef THREADED_DISPATCH
+  // A single instruction, the cycles it takes are left in busy
+  uint64_t cycle = 0;
+  uint64_t deadline = 1;
+  return cpu_dispatch(cpu, &cycle, 1, &deadline);
+#endif
+
+#ifndef NO_BLOCK_CACHE
   // Check for JIT
-  jit_instruction_t jit = cpu->compiled[cpu->program_counter];
-  if (jit.compiled) {
-    cpu->program_counter += jit.size;
+  jit_instruction_t* jit = jit_fetch(cpu);
+  if (jit != NULL) {
+    bool page_crossed = false;
+    uint16_t address =
+        jit->indexed ? jit_address(cpu, jit, &page_crossed) : jit->address;
+    uint8_t cycles = jit->cycles;
+    if (jit->cycle_cross && page_crossed) {
+      cycles++;
+    }
+    cpu->instructions++;
+    cpu->program_counter += jit->size;
+    cpu->block_pc = cpu->program_counter;
     cpu->branch_taken = false;
-    (*jit.execute)(cpu, jit.address);
-    cpu->busy += jit.cycles;
+    (*jit->execute)(cpu, address);
+    cpu->busy += cycles;
     if (cpu->branch_taken) {
       cpu->busy++;
     }
     return false;
   }
+#endif
 
   // Fetch & Decode instruction
+  cpu->instructions++;
   uint8_t opcode = cpu_mem_read8(cpu, cpu->program_counter);
   instruction_t instr = INSTRUCTION_VECTOR[opcode];
   uint8_t bytes_used = 0;
@@ -366,6 +638,42 @@ bool cpu_cycle(cpu_t* cpu) {
   return false;
 }
 
+bool cpu_run(cpu_t* cpu, uint64_t* cycles, uint64_t end,
+             const uint64_t* deadline) {
+  while (*cycles < end && *cycles < *deadline) {
+    if (cpu->busy) {
+      uint64_t skip = cpu->busy;
+      if (skip > end - *cycles) {
+        skip = end - *cycles;
+      }
+      if (skip > *deadline - *cycles) {
+        skip = *deadline - *cycles;
+      }
+      cpu->busy -= skip;
+      *cycles += skip;
+      continue;
+    }
+
+#ifdef THREADED_DISPATCH
+    // Interrupts are only checked for by cpu_cycle
+    if (cpu->last_interrupt == INTRT_NONE && !cpu->nmi_pending) {
+      cpu->status = CS_NONE;
+      if (cpu_dispatch(cpu, cycles, end, deadline)) {
+        return true;
+      }
+      continue;
+    }
+#endif
+
+    bool trapped = cpu_cycle(cpu);
+    (*cycles)++;
+    if (trapped) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void perform_irq(cpu_t* cpu) {
   push16(cpu, cpu->program_counter);
   push8(cpu, cpu->register_status.raw | UNUSED_STATUS_MASK);
@@ -808,282 +1116,422 @@ void cpu_impl_tya(cpu_t* cpu, uint16_t address) {
   cpu_implcommon_set_zs(cpu, cpu->register_a);
 }
 
+/**
+ * Instruction table, in opcode order. Each entry is one of
+ *
+ *   I(opcode, mode, implementation, cycles)
+ *   IC(opcode, mode, implementation, cycles), +1 cycle if a page is crossed
+ *   NI(opcode), not implemented
+ *
+ * The table is expanded into INSTRUCTION_VECTOR and, if THREADED_DISPATCH is
+ * defined, into the per-opcode handlers of cpu_dispatch.
+ */
+#define INSTRUCTIONS(I, IC, NI)        \
+  I(00, IMPLIED, brk, 7)               \
+  I(01, ZERO_PAGE_INDIRECT, ora, 6)    \
+  NI(02)                               \
+  NI(03)                               \
+  NI(04)                               \
+  I(05, ZERO_PAGE, ora, 3)             \
+  I(06, ZERO_PAGE, asl, 5)             \
+  NI(07)                               \
+  I(08, IMPLIED, php, 3)               \
+  I(09, IMMEDIATE, ora, 2)             \
+  I(0A, ACCUMULATOR, asl_special, 2)   \
+  NI(0B)                               \
+  NI(0C)                               \
+  I(0D, ABSOLUTE, ora, 4)              \
+  I(0E, ABSOLUTE, asl, 6)              \
+  NI(0F)                               \
+  IC(10, RELATIVE, bpl, 2)             \
+  IC(11, ZERO_PAGE_INDIRECT_Y, ora, 5) \
+  NI(12)                               \
+  NI(13)                               \
+  NI(14)                               \
+  I(15, ZERO_PAGE_X, ora, 4)           \
+  I(16, ZERO_PAGE_X, asl, 6)           \
+  NI(17)                               \
+  I(18, IMPLIED, clc, 2)               \
+  IC(19, ABSOLUTE_Y, ora, 4)           \
+  NI(1A)                               \
+  NI(1B)                               \
+  NI(1C)                               \
+  IC(1D, ABSOLUTE_X, ora, 4)           \
+  I(1E, ABSOLUTE_X, asl, 7)            \
+  NI(1F)                               \
+  I(20, ABSOLUTE, jsr, 6)              \
+  I(21, ZERO_PAGE_INDIRECT, and, 6)    \
+  NI(22)                               \
+  NI(23)                               \
+  I(24, ZERO_PAGE, bit, 3)             \
+  I(25, ZERO_PAGE, and, 3)             \
+  I(26, ZERO_PAGE, rol, 5)             \
+  NI(27)                               \
+  I(28, IMPLIED, plp, 4)               \
+  I(29, IMMEDIATE, and, 2)             \
+  I(2A, ACCUMULATOR, rol_special, 2)   \
+  NI(2B)                               \
+  I(2C, ABSOLUTE, bit, 4)              \
+  I(2D, ABSOLUTE, and, 4)              \
+  I(2E, ABSOLUTE, rol, 6)              \
+  NI(2F)                               \
+  IC(30, RELATIVE, bmi, 2)             \
+  IC(31, ZERO_PAGE_INDIRECT_Y, and, 5) \
+  NI(32)                               \
+  NI(33)                               \
+  NI(34)                               \
+  I(35, ZERO_PAGE_X, and, 4)           \
+  I(36, ZERO_PAGE_X, rol, 6)           \
+  NI(37)                               \
+  I(38, IMPLIED, sec, 2)               \
+  IC(39, ABSOLUTE_Y, and, 4)           \
+  NI(3A)                               \
+  NI(3B)                               \
+  NI(3C)                               \
+  IC(3D, ABSOLUTE_X, and, 4)           \
+  I(3E, ABSOLUTE_X, rol, 7)            \
+  NI(3F)                               \
+  I(40, IMPLIED, rti, 6)               \
+  I(41, ZERO_PAGE_INDIRECT, eor, 6)    \
+  NI(42)                               \
+  NI(43)                               \
+  NI(44)                               \
+  I(45, ZERO_PAGE, eor, 3)             \
+  I(46, ZERO_PAGE, lsr, 5)             \
+  NI(47)                               \
+  I(48, IMPLIED, pha, 3)               \
+  I(49, IMMEDIATE, eor, 2)             \
+  I(4A, ACCUMULATOR, lsr_special, 2)   \
+  NI(4B)                               \
+  I(4C, ABSOLUTE, jmp, 3)              \
+  I(4D, ABSOLUTE, eor, 4)              \
+  I(4E, ABSOLUTE, lsr, 6)              \
+  NI(4F)                               \
+  IC(50, RELATIVE, bvc, 2)             \
+  IC(51, ZERO_PAGE_INDIRECT_Y, eor, 5) \
+  NI(52)                               \
+  NI(53)                               \
+  NI(54)                               \
+  I(55, ZERO_PAGE_X, eor, 4)           \
+  I(56, ZERO_PAGE_X, lsr, 6)           \
+  NI(57)                               \
+  I(58, IMPLIED, cli, 2)               \
+  IC(59, ABSOLUTE_Y, eor, 4)           \
+  NI(5A)                               \
+  NI(5B)                               \
+  NI(5C)                               \
+  IC(5D, ABSOLUTE_X, eor, 4)           \
+  I(5E, ABSOLUTE_X, lsr, 7)            \
+  NI(5F)                               \
+  I(60, IMPLIED, rts, 6)               \
+  I(61, ZERO_PAGE_INDIRECT, adc, 6)    \
+  NI(62)                               \
+  NI(63)                               \
+  NI(64)                               \
+  I(65, ZERO_PAGE, adc, 3)             \
+  I(66, ZERO_PAGE, ror, 5)             \
+  NI(67)                               \
+  I(68, IMPLIED, pla, 4)               \
+  I(69, IMMEDIATE, adc, 2)             \
+  I(6A, ACCUMULATOR, ror_special, 2)   \
+  NI(6B)                               \
+  I(6C, INDIRECT, jmp, 5)              \
+  I(6D, ABSOLUTE, adc, 4)              \
+  I(6E, ABSOLUTE, ror, 6)              \
+  NI(6F)                               \
+  IC(70, RELATIVE, bvs, 2)             \
+  IC(71, ZERO_PAGE_INDIRECT_Y, adc, 5) \
+  NI(72)                               \
+  NI(73)                               \
+  NI(74)                               \
+  I(75, ZERO_PAGE_X, adc, 4)           \
+  I(76, ZERO_PAGE_X, ror, 6)           \
+  NI(77)                               \
+  I(78, IMPLIED, sei, 2)               \
+  IC(79, ABSOLUTE_Y, adc, 4)           \
+  NI(7A)                               \
+  NI(7B)                               \
+  NI(7C)                               \
+  IC(7D, ABSOLUTE_X, adc, 4)           \
+  I(7E, ABSOLUTE_X, ror, 7)            \
+  NI(7F)                               \
+  NI(80)                               \
+  I(81, ZERO_PAGE_INDIRECT, sta, 6)    \
+  NI(82)                               \
+  NI(83)                               \
+  I(84, ZERO_PAGE, sty, 3)             \
+  I(85, ZERO_PAGE, sta, 3)             \
+  I(86, ZERO_PAGE, stx, 3)             \
+  NI(87)                               \
+  I(88, IMPLIED, dey, 2)               \
+  NI(89)                               \
+  I(8A, IMPLIED, txa, 2)               \
+  NI(8B)                               \
+  I(8C, ABSOLUTE, sty, 4)              \
+  I(8D, ABSOLUTE, sta, 4)              \
+  I(8E, ABSOLUTE, stx, 4)              \
+  NI(8F)                               \
+  IC(90, RELATIVE, bcc, 2)             \
+  I(91, ZERO_PAGE_INDIRECT_Y, sta, 6)  \
+  NI(92)                               \
+  NI(93)                               \
+  I(94, ZERO_PAGE_X, sty, 4)           \
+  I(95, ZERO_PAGE_X, sta, 4)           \
+  I(96, ZERO_PAGE_Y, stx, 4)           \
+  NI(97)                               \
+  I(98, IMPLIED, tya, 2)               \
+  I(99, ABSOLUTE_Y, sta, 5)            \
+  I(9A, IMPLIED, txs, 2)               \
+  NI(9B)                               \
+  NI(9C)                               \
+  I(9D, ABSOLUTE_X, sta, 5)            \
+  NI(9E)                               \
+  NI(9F)                               \
+  I(A0, IMMEDIATE, ldy, 2)             \
+  I(A1, ZERO_PAGE_INDIRECT, lda, 6)    \
+  I(A2, IMMEDIATE, ldx, 2)             \
+  NI(A3)                               \
+  I(A4, ZERO_PAGE, ldy, 3)             \
+  I(A5, ZERO_PAGE, lda, 3)             \
+  I(A6, ZERO_PAGE, ldx, 3)             \
+  NI(A7)                               \
+  I(A8, IMPLIED, tay, 2)               \
+  I(A9, IMMEDIATE, lda, 2)             \
+  I(AA, IMPLIED, tax, 2)               \
+  NI(AB)                               \
+  I(AC, ABSOLUTE, ldy, 4)              \
+  I(AD, ABSOLUTE, lda, 4)              \
+  I(AE, ABSOLUTE, ldx, 4)              \
+  NI(AF)                               \
+  IC(B0, RELATIVE, bcs, 2)             \
+  IC(B1, ZERO_PAGE_INDIRECT_Y, lda, 5) \
+  NI(B2)                               \
+  NI(B3)                               \
+  I(B4, ZERO_PAGE_X, ldy, 4)           \
+  I(B5, ZERO_PAGE_X, lda, 4)           \
+  I(B6, ZERO_PAGE_Y, ldx, 4)           \
+  NI(B7)                               \
+  I(B8, IMPLIED, clv, 2)               \
+  IC(B9, ABSOLUTE_Y, lda, 4)           \
+  I(BA, IMPLIED, tsx, 2)               \
+  NI(BB)                               \
+  IC(BC, ABSOLUTE_X, ldy, 4)           \
+  IC(BD, ABSOLUTE_X, lda, 4)           \
+  IC(BE, ABSOLUTE_Y, ldx, 4)           \
+  NI(BF)                               \
+  I(C0, IMMEDIATE, cpy, 2)             \
+  I(C1, ZERO_PAGE_INDIRECT, cmp, 6)    \
+  NI(C2)                               \
+  NI(C3)                               \
+  I(C4, ZERO_PAGE, cpy, 3)             \
+  I(C5, ZERO_PAGE, cmp, 3)             \
+  I(C6, ZERO_PAGE, dec, 5)             \
+  NI(C7)                               \
+  I(C8, IMPLIED, iny, 2)               \
+  I(C9, IMMEDIATE, cmp, 2)             \
+  I(CA, IMPLIED, dex, 2)               \
+  NI(CB)                               \
+  I(CC, ABSOLUTE, cpy, 4)              \
+  I(CD, ABSOLUTE, cmp, 4)              \
+  I(CE, ABSOLUTE, dec, 6)              \
+  NI(CF)                               \
+  IC(D0, RELATIVE, bne, 2)             \
+  IC(D1, ZERO_PAGE_INDIRECT_Y, cmp, 5) \
+  NI(D2)                               \
+  NI(D3)                               \
+  NI(D4)                               \
+  I(D5, ZERO_PAGE_X, cmp, 4)           \
+  I(D6, ZERO_PAGE_X, dec, 6)           \
+  NI(D7)                               \
+  I(D8, IMPLIED, cld, 2)               \
+  IC(D9, ABSOLUTE_Y, cmp, 4)           \
+  NI(DA)                               \
+  NI(DB)                               \
+  NI(DC)                               \
+  IC(DD, ABSOLUTE_X, cmp, 4)           \
+  I(DE, ABSOLUTE_X, dec, 7)            \
+  NI(DF)                               \
+  I(E0, IMMEDIATE, cpx, 2)             \
+  I(E1, ZERO_PAGE_INDIRECT, sbc, 6)    \
+  NI(E2)                               \
+  NI(E3)                               \
+  I(E4, ZERO_PAGE, cpx, 3)             \
+  I(E5, ZERO_PAGE, sbc, 3)             \
+  I(E6, ZERO_PAGE, inc, 5)             \
+  NI(E7)                               \
+  I(E8, IMPLIED, inx, 2)               \
+  I(E9, IMMEDIATE, sbc, 2)             \
+  I(EA, IMPLIED, nop, 2)               \
+  NI(EB)                               \
+  I(EC, ABSOLUTE, cpx, 4)              \
+  I(ED, ABSOLUTE, sbc, 4)              \
+  I(EE, ABSOLUTE, inc, 6)              \
+  NI(EF)                               \
+  IC(F0, RELATIVE, beq, 2)             \
+  IC(F1, ZERO_PAGE_INDIRECT_Y, sbc, 5) \
+  NI(F2)                               \
+  NI(F3)                               \
+  NI(F4)                               \
+  I(F5, ZERO_PAGE_X, sbc, 4)           \
+  I(F6, ZERO_PAGE_X, inc, 6)           \
+  NI(F7)                               \
+  I(F8, IMPLIED, sed, 2)               \
+  IC(F9, ABSOLUTE_Y, sbc, 4)           \
+  NI(FA)                               \
+  NI(FB)                               \
+  NI(FC)                               \
+  IC(FD, ABSOLUTE_X, sbc, 4)           \
+  I(FE, ABSOLUTE_X, inc, 7)            \
+  NI(FF)
+
 // Macros to define instructions
-#define I(A, B, C)                                                   \
+#define I(N, A, B, C)                                                \
   {                                                                  \
     .mode = AM_##A, .mnemonic = #B, .implementation = &cpu_impl_##B, \
     .cycles = C, .cycle_cross = false                                \
-  }
-#define IC(A, B, C)                                                  \
+  },
+#define IC(N, A, B, C)                                               \
   {                                                                  \
     .mode = AM_##A, .mnemonic = #B, .implementation = &cpu_impl_##B, \
     .cycles = C, .cycle_cross = true                                 \
-  }
-#define NI \
-  { .mode = AM_ACCUMULATOR, .mnemonic = "###", .implementation = NULL }
+  },
+#define NI(N)                                                          \
+  {.mode = AM_ACCUMULATOR, .mnemonic = "###", .implementation = NULL},
 
 const instruction_t INSTRUCTION_VECTOR[NUM_INSTRUCTIONS] = {
-    I(IMPLIED, brk, 7),
-    I(ZERO_PAGE_INDIRECT, ora, 6),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE, ora, 3),
-    I(ZERO_PAGE, asl, 5),
-    NI,
-    I(IMPLIED, php, 3),
-    I(IMMEDIATE, ora, 2),
-    I(ACCUMULATOR, asl_special, 2),
-    NI,
-    NI,
-    I(ABSOLUTE, ora, 4),
-    I(ABSOLUTE, asl, 6),
-    NI,
-    IC(RELATIVE, bpl, 2),
-    IC(ZERO_PAGE_INDIRECT_Y, ora, 5),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE_X, ora, 4),
-    I(ZERO_PAGE_X, asl, 6),
-    NI,
-    I(IMPLIED, clc, 2),
-    IC(ABSOLUTE_Y, ora, 4),
-    NI,
-    NI,
-    NI,
-    IC(ABSOLUTE_X, ora, 4),
-    I(ABSOLUTE_X, asl, 7),
-    NI,
-    I(ABSOLUTE, jsr, 6),
-    I(ZERO_PAGE_INDIRECT, and, 6),
-    NI,
-    NI,
-    I(ZERO_PAGE, bit, 3),
-    I(ZERO_PAGE, and, 3),
-    I(ZERO_PAGE, rol, 5),
-    NI,
-    I(IMPLIED, plp, 4),
-    I(IMMEDIATE, and, 2),
-    I(ACCUMULATOR, rol_special, 2),
-    NI,
-    I(ABSOLUTE, bit, 4),
-    I(ABSOLUTE, and, 4),
-    I(ABSOLUTE, rol, 6),
-    NI,
-    IC(RELATIVE, bmi, 2),
-    IC(ZERO_PAGE_INDIRECT_Y, and, 5),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE_X, and, 4),
-    I(ZERO_PAGE_X, rol, 6),
-    NI,
-    I(IMPLIED, sec, 2),
-    IC(ABSOLUTE_Y, and, 4),
-    NI,
-    NI,
-    NI,
-    IC(ABSOLUTE_X, and, 4),
-    I(ABSOLUTE_X, rol, 7),
-    NI,
-    I(IMPLIED, rti, 6),
-    I(ZERO_PAGE_INDIRECT, eor, 6),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE, eor, 3),
-    I(ZERO_PAGE, lsr, 5),
-    NI,
-    I(IMPLIED, pha, 3),
-    I(IMMEDIATE, eor, 2),
-    I(ACCUMULATOR, lsr_special, 2),
-    NI,
-    I(ABSOLUTE, jmp, 3),
-    I(ABSOLUTE, eor, 4),
-    I(ABSOLUTE, lsr, 6),
-    NI,
-    IC(RELATIVE, bvc, 2),
-    IC(ZERO_PAGE_INDIRECT_Y, eor, 5),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE_X, eor, 4),
-    I(ZERO_PAGE_X, lsr, 6),
-    NI,
-    I(IMPLIED, cli, 2),
-    IC(ABSOLUTE_Y, eor, 4),
-    NI,
-    NI,
-    NI,
-    IC(ABSOLUTE_X, eor, 4),
-    I(ABSOLUTE_X, lsr, 7),
-    NI,
-    I(IMPLIED, rts, 6),
-    I(ZERO_PAGE_INDIRECT, adc, 6),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE, adc, 3),
-    I(ZERO_PAGE, ror, 5),
-    NI,
-    I(IMPLIED, pla, 4),
-    I(IMMEDIATE, adc, 2),
-    I(ACCUMULATOR, ror_special, 2),
-    NI,
-    I(INDIRECT, jmp, 5),
-    I(ABSOLUTE, adc, 4),
-    I(ABSOLUTE, ror, 6),
-    NI,
-    IC(RELATIVE, bvs, 2),
-    IC(ZERO_PAGE_INDIRECT_Y, adc, 5),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE_X, adc, 4),
-    I(ZERO_PAGE_X, ror, 6),
-    NI,
-    I(IMPLIED, sei, 2),
-    IC(ABSOLUTE_Y, adc, 4),
-    NI,
-    NI,
-    NI,
-    IC(ABSOLUTE_X, adc, 4),
-    I(ABSOLUTE_X, ror, 7),
-    NI,
-    NI,
-    I(ZERO_PAGE_INDIRECT, sta, 6),
-    NI,
-    NI,
-    I(ZERO_PAGE, sty, 3),
-    I(ZERO_PAGE, sta, 3),
-    I(ZERO_PAGE, stx, 3),
-    NI,
-    I(IMPLIED, dey, 2),
-    NI,
-    I(IMPLIED, txa, 2),
-    NI,
-    I(ABSOLUTE, sty, 4),
-    I(ABSOLUTE, sta, 4),
-    I(ABSOLUTE, stx, 4),
-    NI,
-    IC(RELATIVE, bcc, 2),
-    I(ZERO_PAGE_INDIRECT_Y, sta, 6),
-    NI,
-    NI,
-    I(ZERO_PAGE_X, sty, 4),
-    I(ZERO_PAGE_X, sta, 4),
-    I(ZERO_PAGE_Y, stx, 4),
-    NI,
-    I(IMPLIED, tya, 2),
-    I(ABSOLUTE_Y, sta, 5),
-    I(IMPLIED, txs, 2),
-    NI,
-    NI,
-    I(ABSOLUTE_X, sta, 5),
-    NI,
-    NI,
-    I(IMMEDIATE, ldy, 2),
-    I(ZERO_PAGE_INDIRECT, lda, 6),
-    I(IMMEDIATE, ldx, 2),
-    NI,
-    I(ZERO_PAGE, ldy, 3),
-    I(ZERO_PAGE, lda, 3),
-    I(ZERO_PAGE, ldx, 3),
-    NI,
-    I(IMPLIED, tay, 2),
-    I(IMMEDIATE, lda, 2),
-    I(IMPLIED, tax, 2),
-    NI,
-    I(ABSOLUTE, ldy, 4),
-    I(ABSOLUTE, lda, 4),
-    I(ABSOLUTE, ldx, 4),
-    NI,
-    IC(RELATIVE, bcs, 2),
-    IC(ZERO_PAGE_INDIRECT_Y, lda, 5),
-    NI,
-    NI,
-    I(ZERO_PAGE_X, ldy, 4),
-    I(ZERO_PAGE_X, lda, 4),
-    I(ZERO_PAGE_Y, ldx, 4),
-    NI,
-    I(IMPLIED, clv, 2),
-    IC(ABSOLUTE_Y, lda, 4),
-    I(IMPLIED, tsx, 2),
-    NI,
-    IC(ABSOLUTE_X, ldy, 4),
-    IC(ABSOLUTE_X, lda, 4),
-    IC(ABSOLUTE_Y, ldx, 4),
-    NI,
-    I(IMMEDIATE, cpy, 2),
-    I(ZERO_PAGE_INDIRECT, cmp, 6),
-    NI,
-    NI,
-    I(ZERO_PAGE, cpy, 3),
-    I(ZERO_PAGE, cmp, 3),
-    I(ZERO_PAGE, dec, 5),
-    NI,
-    I(IMPLIED, iny, 2),
-    I(IMMEDIATE, cmp, 2),
-    I(IMPLIED, dex, 2),
-    NI,
-    I(ABSOLUTE, cpy, 4),
-    I(ABSOLUTE, cmp, 4),
-    I(ABSOLUTE, dec, 6),
-    NI,
-    IC(RELATIVE, bne, 2),
-    IC(ZERO_PAGE_INDIRECT_Y, cmp, 5),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE_X, cmp, 4),
-    I(ZERO_PAGE_X, dec, 6),
-    NI,
-    I(IMPLIED, cld, 2),
-    IC(ABSOLUTE_Y, cmp, 4),
-    NI,
-    NI,
-    NI,
-    IC(ABSOLUTE_X, cmp, 4),
-    I(ABSOLUTE_X, dec, 7),
-    NI,
-    I(IMMEDIATE, cpx, 2),
-    I(ZERO_PAGE_INDIRECT, sbc, 6),
-    NI,
-    NI,
-    I(ZERO_PAGE, cpx, 3),
-    I(ZERO_PAGE, sbc, 3),
-    I(ZERO_PAGE, inc, 5),
-    NI,
-    I(IMPLIED, inx, 2),
-    I(IMMEDIATE, sbc, 2),
-    I(IMPLIED, nop, 2),
-    NI,
-    I(ABSOLUTE, cpx, 4),
-    I(ABSOLUTE, sbc, 4),
-    I(ABSOLUTE, inc, 6),
-    NI,
-    IC(RELATIVE, beq, 2),
-    IC(ZERO_PAGE_INDIRECT_Y, sbc, 5),
-    NI,
-    NI,
-    NI,
-    I(ZERO_PAGE_X, sbc, 4),
-    I(ZERO_PAGE_X, inc, 6),
-    NI,
-    I(IMPLIED, sed, 2),
-    IC(ABSOLUTE_Y, sbc, 4),
-    NI,
-    NI,
-    NI,
-    IC(ABSOLUTE_X, sbc, 4),
-    I(ABSOLUTE_X, inc, 7),
-    NI,
-};
+    INSTRUCTIONS(I, IC, NI)};
+
+#undef I
+#undef IC
+#undef NI
 
+#ifdef THREADED_DISPATCH
+/**
+ * Threaded dispatch
+ *
+ * Every opcode gets its own handler, with the addressing mode resolved inline
+ * and the implementation called directly. Each handler ends by fetching the
+ * next opcode and jumping through the label table itself, so that every
+ * handler has its own indirect jump, which the branch predictor can learn
+ * separately, instead of a single shared one. Control only returns to cpu_run
+ * when the next instruction would not start before the end of the run, or an
+ * interrupt is pending. Handlers perform the same memory accesses in the same
+ * order as instr_address.
+ *
+ * Labels as values are a GNU extension supported by GCC and Clang.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#define DISPATCH_ACCUMULATOR(PC) \
+  uint16_t address = 0;          \
+  uint8_t size = 1;
+#define DISPATCH_IMPLIED(PC) DISPATCH_ACCUMULATOR(PC)
+#define DISPATCH_IMMEDIATE(PC) \
+  uint16_t address = PC + 1;   \
+  uint8_t size = 2;
+#define DISPATCH_ABSOLUTE(PC)                     \
+  uint16_t address = cpu_mem_read16(cpu, PC + 1); \
+  uint8_t size = 3;
+#define DISPATCH_ZERO_PAGE(PC)                   \
+  uint16_t address = cpu_mem_read8(cpu, PC + 1); \
+  uint8_t size = 2;
+#define DISPATCH_RELATIVE(PC)                                       \
+  uint8_t offset = cpu_mem_read8(cpu, PC + 1);                      \
+  uint16_t address = PC + 2 + offset - (offset < 0x80 ? 0 : 0x100); \
+  uint8_t size = 2;
+#define DISPATCH_INDEXED(PC, BASE, INDEX, SIZE)                             \
+  uint16_t address = BASE;                                                  \
+  page_crossed = is_page_crossed(address, address + cpu->register_##INDEX); \
+  address += cpu->register_##INDEX;                                         \
+  uint8_t size = SIZE;
+#define DISPATCH_ABSOLUTE_X(PC)                           \
+  DISPATCH_INDEXED(PC, cpu_mem_read16(cpu, PC + 1), x, 3)
+#define DISPATCH_ABSOLUTE_Y(PC)                           \
+  DISPATCH_INDEXED(PC, cpu_mem_read16(cpu, PC + 1), y, 3)
+#define DISPATCH_ZERO_PAGE_X(PC)                                            \
+  uint16_t address = (cpu_mem_read8(cpu, PC + 1) + cpu->register_x) & 0xFF; \
+  uint8_t size = 2;
+#define DISPATCH_ZERO_PAGE_Y(PC)                                            \
+  uint16_t address = (cpu_mem_read8(cpu, PC + 1) + cpu->register_y) & 0xFF; \
+  uint8_t size = 2;
+#define DISPATCH_ZERO_PAGE_INDIRECT(PC)                            \
+  uint16_t address = cpu_mem_read16_bug(                           \
+      cpu, (cpu_mem_read8(cpu, PC + 1) + cpu->register_x) & 0xFF); \
+  uint8_t size = 2;
+#define DISPATCH_ZERO_PAGE_INDIRECT_Y(PC)                               \
+  DISPATCH_INDEXED(PC, cpu_mem_read16_bug(cpu, cpu_mem_read8(cpu, PC + 1)), \
+                   y, 2)
+#define DISPATCH_INDIRECT(PC)                                              \
+  uint16_t address = cpu_mem_read16_bug(cpu, cpu_mem_read16(cpu, PC + 1)); \
+  uint8_t size = 3;
+
+// Accounts for the instruction just executed, then jumps to the next one if it
+// starts before the end of the run, skipping the cycles spent busy
+#define DISPATCH_NEXT                                                 \
+  if (cpu->branch_taken) {                                            \
+    cpu->busy++;                                                      \
+  }                                                                   \
+  cpu->instructions++;                                                \
+  (*cycles)++;                                                        \
+  if (*cycles + cpu->busy >= end || *cycles + cpu->busy >= *deadline || \
+      cpu->last_interrupt != INTRT_NONE || cpu->nmi_pending) {        \
+    return false;                                                     \
+  }                                                                   \
+  *cycles += cpu->busy;                                               \
+  cpu->busy = 0;                                                      \
+  cpu->branch_taken = false;                                          \
+  page_crossed = false;                                               \
+  goto* HANDLERS[cpu_mem_read8(cpu, cpu->program_counter)];
+
+// Handlers
+#define I(N, A, B, C)                  \
+  op_##N : {                           \
+    DISPATCH_##A(cpu->program_counter) \
+    cpu->program_counter += size;      \
+    cpu_impl_##B(cpu, address);        \
+    cpu->busy += C;                    \
+    DISPATCH_NEXT                      \
+  }
+#define IC(N, A, B, C)                 \
+  op_##N : {                           \
+    DISPATCH_##A(cpu->program_counter) \
+    cpu->program_counter += size;      \
+    cpu_impl_##B(cpu, address);        \
+    cpu->busy += C + page_crossed;     \
+    DISPATCH_NEXT                      \
+  }
+// Not implemented, the same opcode is fetched again in the next cycle
+#define NI(N)        \
+  op_##N : {         \
+    DISPATCH_NEXT    \
+  }
+
+// Label table
+#define L(N, A, B, C) [0x##N] = &&op_##N,
+#define LNI(N) [0x##N] = &&op_##N,
+
+static bool cpu_dispatch(cpu_t* cpu, uint64_t* cycles, uint64_t end,
+                         const uint64_t* deadline) {
+  static const void* const HANDLERS[NUM_INSTRUCTIONS] = {
+      INSTRUCTIONS(L, L, LNI)};
+
+  bool page_crossed = false;
+  cpu->branch_taken = false;
+  goto* HANDLERS[cpu_mem_read8(cpu, cpu->program_counter)];
+
+  INSTRUCTIONS(I, IC, NI)
+}
+
+#undef DISPATCH_NEXT
 #undef I
 #undef IC
 #undef NI
+#undef L
+#undef LNI
+
+#pragma GCC diagnostic pop
+#endif
 
 // Debugging utils
 const char* dbg_address_mode_to_string(address_mode_t mode) {
@@ -0,0 +1,64 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "event.h"
+
+/**
+ * event.c
+ */
+
+/**
+ * Public functions
+ *
+ * See event.h for descriptions.
+ */
+event_queue_t* event_init(void) {
+  event_queue_t* events = malloc(sizeof(event_queue_t));
+  if (events == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < EV_COUNT; i++) {
+    events->times[i] = EVENT_NEVER;
+  }
+  return events;
+}
+
+void event_schedule(event_queue_t* events, event_kind_t kind, uint64_t time) {
+  events->times[kind] = time;
+}
+
+uint64_t event_next(event_queue_t* events) {
+  uint64_t next = EVENT_NEVER;
+  for (int i = 0; i < EV_COUNT; i++) {
+    if (events->times[i] < next) {
+      next = events->times[i];
+    }
+  }
+  return next;
+}
+
+void event_deinit(event_queue_t* events) { free(events); }
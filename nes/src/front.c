@@ -23,7 +23,9 @@
  * SOFTWARE.
  */
 
+#ifndef HEADLESS
 #include <nfd.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,6 +38,7 @@
  * front.c
  */
 
+#ifndef HEADLESS
 char* front_rom_dialog(void) {
   nfdchar_t* nfd_path = NULL;
   nfdresult_t result = NFD_OpenDialog(NULL, NULL, &nfd_path);
@@ -49,6 +52,7 @@ char* front_rom_dialog(void) {
   }
   return NULL;
 }
+#endif
 
 front_t* front_init(sys_t* sys) {
   front_t* front = malloc(sizeof(front_t));
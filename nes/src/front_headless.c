@@ -0,0 +1,223 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apu.h"
+#include "front.h"
+#include "front_headless.h"
+#include "palette.h"
+#include "ppu.h"
+#include "sys.h"
+
+/**
+ * front_headless.c
+ */
+
+/**
+ * The NES palette, in ARGB8888 format. These are the same colours as the
+ * palette in assets/pines.png used by the SDL front.
+ */
+static const uint32_t FRONT_HEADLESS_PALETTE[64] = {
+    0xFF7C7C7C, 0xFF0000FC, 0xFF0000BC, 0xFF4428BC, 0xFF940083, 0xFFA8001F,
+    0xFFA81000, 0xFF881400, 0xFF503000, 0xFF007800, 0xFF006800, 0xFF005801,
+    0xFF004058, 0xFF000000, 0xFF010000, 0xFF010000, 0xFFBCBCBC, 0xFF0078F8,
+    0xFF0058F8, 0xFF6844FC, 0xFFD800CB, 0xFFE40057, 0xFFF83800, 0xFFE45C10,
+    0xFFAC7C00, 0xFF00B800, 0xFF00A800, 0xFF00A844, 0xFF008888, 0xFF000001,
+    0xFF010001, 0xFF010001, 0xFFF8F8F8, 0xFF3CBCFC, 0xFF6888FC, 0xFF9878F8,
+    0xFFF878F7, 0xFFF85897, 0xFFF87858, 0xFFFCA044, 0xFFF8B800, 0xFFB7F818,
+    0xFF57D854, 0xFF57F898, 0xFF00E8D8, 0xFF777777, 0xFF000000, 0xFF000101,
+    0xFFFCFCFC, 0xFFA4E4FC, 0xFFB8B8F8, 0xFFD8B8F8, 0xFFF8B8F8, 0xFFF8A4C0,
+    0xFFF0D0B0, 0xFFFCE0A8, 0xFFF8D878, 0xFFD8F878, 0xFFB8F8B8, 0xFFB7F8D8,
+    0xFF00FCFC, 0xFFF5D5F5, 0xFF000000, 0xFF020101};
+
+#define WAV_HEADER_SIZE 44
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+
+/**
+ * Private functions
+ *
+ * front_headless_write_le
+ *   Writes an integer of the given size in little endian.
+ *
+ * front_headless_wav_header
+ *   Writes the header of a mono WAV file with the given number of samples, in
+ *   the output format of the APU.
+ *
+ * front_headless_audio_enqueue
+ *   APU callback, appends the samples to the audio file.
+ *
+ * front_headless_dump_screen
+ *   Writes the PPU screen to a binary PPM file.
+ */
+static void front_headless_write_le(FILE* fp, uint32_t value, uint8_t size) {
+  for (uint8_t i = 0; i < size; i++) {
+    fputc((value >> (i * 8)) & 0xFF, fp);
+  }
+}
+
+static void front_headless_wav_header(FILE* fp, const apu_output_t* output,
+                                      uint32_t samples) {
+  uint32_t sample_size = apu_sample_size(output->format);
+  uint32_t data_size = samples * sample_size;
+  fwrite("RIFF", 1, 4, fp);
+  front_headless_write_le(fp, WAV_HEADER_SIZE - 8 + data_size, 4);
+  fwrite("WAVEfmt ", 1, 8, fp);
+  front_headless_write_le(fp, 16, 4);
+  front_headless_write_le(
+      fp, output->format == AF_S16 ? WAV_FORMAT_PCM : WAV_FORMAT_FLOAT, 2);
+  front_headless_write_le(fp, 1, 2);  // Channels
+  front_headless_write_le(fp, output->rate, 4);
+  front_headless_write_le(fp, output->rate * sample_size, 4);
+  front_headless_write_le(fp, sample_size, 2);
+  front_headless_write_le(fp, sample_size * 8, 2);
+  fwrite("data", 1, 4, fp);
+  front_headless_write_le(fp, data_size, 4);
+}
+
+static void front_headless_audio_enqueue(void* context, const void* samples,
+                                         int len) {
+  front_headless_impl_t* impl = (front_headless_impl_t*)context;
+  // Host byte order, which is little endian on all supported platforms
+  fwrite(samples, apu_sample_size(impl->audio_output.format), len,
+         impl->audio);
+  impl->audio_samples += len;
+}
+
+static apu_queued_size_t front_headless_audio_get_queue_size(void* context) {
+  return 0;
+}
+
+static bool front_headless_dump_screen(front_headless_impl_t* impl) {
+  FILE* fp = fopen(impl->screen_path, "wb");
+  if (fp == NULL) {
+    return false;
+  }
+  // Only the frame written out is ever converted
+  ppu_t* ppu = impl->front->sys->ppu;
+  palette_t palette;
+  palette_init(&palette, PF_ARGB8888, ppu->nes_palette_direct);
+  uint32_t* screen = malloc(sizeof(uint32_t) * PPU_SCREEN_SIZE);
+  palette_convert(&palette, ppu_frame_acquire(ppu), screen,
+                  PPU_SCREEN_WIDTH * sizeof(uint32_t));
+  fprintf(fp, "P6\n%d %d\n255\n", PPU_SCREEN_WIDTH, PPU_SCREEN_HEIGHT);
+  for (int i = 0; i < PPU_SCREEN_SIZE; i++) {
+    fputc((screen[i] >> 16) & 0xFF, fp);
+    fputc((screen[i] >> 8) & 0xFF, fp);
+    fputc(screen[i] & 0xFF, fp);
+  }
+  free(screen);
+  fclose(fp);
+  return true;
+}
+
+/**
+ * Public functions
+ */
+front_headless_impl_t* front_headless_impl_init(front_t* front) {
+  front_headless_impl_t* impl = malloc(sizeof(front_headless_impl_t));
+  impl->frames = FRONT_HEADLESS_DEFAULT_FRAMES;
+  impl->render_every = 1;
+  impl->screen_path = NULL;
+  impl->audio_path = NULL;
+  // Captures are worth the widest kernels
+  impl->audio_output.rate = APU_ACTUAL_SAMPLE_RATE;
+  impl->audio_output.format = AF_F32;
+  impl->audio_output.quality = AQ_HIGH;
+  impl->audio_output.queue_target = 0;
+  impl->audio = NULL;
+  impl->audio_samples = 0;
+  impl->front = front;
+
+  memcpy(front->sys->ppu->nes_palette_direct, FRONT_HEADLESS_PALETTE,
+         sizeof(FRONT_HEADLESS_PALETTE));
+  return impl;
+}
+
+void front_headless_impl_run(front_headless_impl_t* impl) {
+  sys_t* sys = impl->front->sys;
+  if (!sys->running) {
+    fprintf(stderr, "No ROM running\n");
+    return;
+  }
+
+  if (impl->audio_path != NULL) {
+    if (!apu_configure_output(sys->apu, &impl->audio_output)) {
+      fprintf(stderr, "Could not configure the audio output\n");
+      return;
+    }
+    impl->audio = fopen(impl->audio_path, "wb");
+    if (impl->audio == NULL) {
+      fprintf(stderr, "Could not open %s\n", impl->audio_path);
+      return;
+    }
+    // Written again with the final size once done
+    front_headless_wav_header(impl->audio, &impl->audio_output, 0);
+    sys_audio(sys, impl, &front_headless_audio_enqueue,
+              &front_headless_audio_get_queue_size);
+  } else {
+    sys_audio(sys, NULL, NULL, NULL);
+  }
+
+  clock_t start = clock();
+  uint32_t frames = 0;
+  while (frames < impl->frames) {
+    // Skipped frames keep their timing and side effects, but are not drawn
+    sys->ppu->render = (frames + 1) % impl->render_every == 0 ||
+                       frames + 1 == impl->frames;
+    if (sys_run_frame(sys)) {
+      break;
+    }
+    frames++;
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("frames: %u\n", frames);
+  printf("time:   %.3f s\n", seconds);
+  if (seconds > 0) {
+    printf("fps:    %.1f\n", frames / seconds);
+  }
+  if (sys->status != SS_NONE) {
+    fprintf(stderr, "System stopped with status %d\n", sys->status);
+  }
+
+  if (impl->audio != NULL) {
+    rewind(impl->audio);
+    front_headless_wav_header(impl->audio, &impl->audio_output,
+                              impl->audio_samples);
+    fclose(impl->audio);
+    impl->audio = NULL;
+  }
+
+  if (impl->screen_path != NULL && !front_headless_dump_screen(impl)) {
+    fprintf(stderr, "Could not write %s\n", impl->screen_path);
+  }
+}
+
+void front_headless_impl_deinit(front_headless_impl_t* impl) { free(impl); }
@@ -31,7 +31,6 @@
 #include <string.h>
 
 #include "apu.h"
-#include "controller_sdl.h"
 #include "error.h"
 #include "front.h"
 #include "front_sdl.h"
@@ -107,6 +106,13 @@ static uint8_t PROFILER_COLOURS[] = {
  * flip
  *   Updates the window with the current screen data, and draws any UI
  *   on top of the screen as necessary.
+ *
+ * show_reports
+ *   Displays the errors reported by the emulation thread.
+ *
+ * audio_callback
+ *   Called by SDL on its audio thread, pulls the audio from the emulation
+ *   thread.
  */
 static void display_number(front_sdl_impl_t* impl, uint32_t num, uint16_t x,
                            uint16_t y) {
@@ -167,7 +173,7 @@ static void preflip(front_sdl_impl_t* impl) {
   SDL_SetRenderDrawColor(impl->renderer, 0, 0, 0, 255);
   SDL_RenderClear(impl->renderer);
 
-  PROFILER_POINT(PREFLIP)
+  PROFILER_POINT(impl->profiler, PREFLIP)
 }
 
 static void flip(front_sdl_impl_t* impl) {
@@ -179,9 +185,12 @@ static void flip(front_sdl_impl_t* impl) {
   SDL_Rect src;
   SDL_Rect dest;
 
+  // The debugging tabs read the system, stopping emulation meanwhile
+  bool debug = impl->front->tab != FT_SCREEN;
+  if (debug) {
+    SDL_LockMutex(impl->emu->lock);
+  }
   sys_t* sys = impl->front->sys;
-  mapper_t* mapper = sys->mapper;
-  uint16_t pc = sys->cpu->program_counter;
   switch (impl->front->tab) {
     case FT_PPU: {
       // PPU OAM data
@@ -215,7 +224,8 @@ static void flip(front_sdl_impl_t* impl) {
         }
       } else {
         for (int i = 0; i < 32; i++) {
-          uint32_t colour = sys->ppu->palette_cache[i];
+          uint32_t colour =
+              sys->ppu->nes_palette_direct[sys->ppu->palette_cache[i]];
           SDL_SetRenderDrawColor(impl->renderer, colour >> 16, colour >> 8,
                                  colour, 0xFF);
           rect.x = (i % 16) * 16;
@@ -230,9 +240,9 @@ static void flip(front_sdl_impl_t* impl) {
       display_number(impl, impl->mouse_x, x_edge - 106, y_edge - 36);
       display_number(impl, impl->mouse_y, x_edge - 76, y_edge - 36);
       if (impl->mouse_x < 256 && impl->mouse_y < 240) {
-        display_number(
-            impl, sys->ppu->screen_dbg[impl->mouse_x + impl->mouse_y * 256],
-            x_edge - 46, y_edge - 36);
+        display_number(impl,
+                       impl->frame->screen[impl->mouse_x + impl->mouse_y * 256],
+                       x_edge - 46, y_edge - 36);
       }
     } break;
     case FT_APU: {
@@ -291,6 +301,15 @@ static void flip(front_sdl_impl_t* impl) {
       display_text(impl, "T Div T Per Len P Len L Len H Enbld", left + 40,
                    offset);
 
+      // Audio queue between the emulation thread and the audio callback, and
+      // the nudge of rate control keeping it filled
+      front_sdl_emu_audio_stats_t stats;
+      front_sdl_emu_audio_stats(impl->emu, &stats);
+      sprintf(bufstr, "   Queue %04u %03ums Under %05u Over %05u Rate %+.2f%%",
+              stats.queued, stats.queued * 1000 / sys->apu->config.rate,
+              stats.underruns, stats.overruns, sys->apu->rate_adjust * 100);
+      display_text(impl, bufstr, left, 80 + offset);
+
       // Display the audio buffer
       dest.x = 0;
       dest.y = 0;
@@ -300,7 +319,7 @@ static void flip(front_sdl_impl_t* impl) {
       // int step = AUDIO_BUFFER_SIZE / 256;
       int j = sys->apu->buffer_cursor;
       for (int i = 0; i < 256; i++) {
-        dest.y = y_edge - 1 - sys->apu->buffer[j % AUDIO_BUFFER_SIZE] * 32.0;
+        dest.y = y_edge - 17 - sys->apu->buffer[j % AUDIO_BUFFER_SIZE] * 32.0;
         SDL_RenderFillRect(impl->renderer, &dest);
         j++;
         dest.x++;
@@ -344,6 +363,8 @@ static void flip(front_sdl_impl_t* impl) {
     case FT_MMC_CPU:  // pass through
     case FT_MMC_PPU: {
       // Display the memory map
+      mapper_t* mapper = sys->mapper;
+      uint16_t pc = sys->cpu->program_counter;
       if (mapper != NULL) {
         uint32_t* pixels;
         uint32_t pitch;
@@ -376,6 +397,9 @@ static void flip(front_sdl_impl_t* impl) {
     default:
       break;
   }
+  if (debug) {
+    SDL_UnlockMutex(impl->emu->lock);
+  }
 
   // Render the UI
   src.x = 0;
@@ -414,16 +438,17 @@ static void flip(front_sdl_impl_t* impl) {
     SDL_RenderCopy(impl->renderer, impl->ui, &src, &dest);
   }
 
-  if (sys->status != SS_NONE) {
+  sys_status_t status = front_sdl_emu_status(impl->emu);
+  if (status != SS_NONE) {
     // Render system status
-    src.x = (sys->status - 1) * 24;
+    src.x = (status - 1) * 24;
     src.y = 48;
     src.w = dest.w = 24;
     src.h = dest.h = 24;
     dest.x = x_mid - 12;
     dest.y = y_mid - 12;
     SDL_RenderCopy(impl->renderer, impl->ui, &src, &dest);
-  } else if (!sys->running) {
+  } else if (!front_sdl_emu_running(impl->emu)) {
     // Display pines logo
     src.x = 128;
     src.y = 32;
@@ -441,21 +466,24 @@ static void flip(front_sdl_impl_t* impl) {
                  impl->screen_rect->h - 12);
   }
 
-  PROFILER_POINT(END)
+  PROFILER_POINT(impl->profiler, END)
 
 #ifdef PROFILER
-  // Display profiler data
-  float* times = profiler_get_times();
-  dest.x = 0;
-  dest.y = impl->screen_rect->h - 6;
-  dest.h = 6;
-  for (int i = 0; i < PROFILER_NUM_POINTS; i++) {
-    dest.w = times[i] * 256;
-    SDL_SetRenderDrawColor(impl->renderer, PROFILER_COLOURS[i * 3],
-                           PROFILER_COLOURS[i * 3 + 1],
-                           PROFILER_COLOURS[i * 3 + 2], 0xFF);
-    SDL_RenderFillRect(impl->renderer, &dest);
-    dest.x += dest.w;
+  // Display profiler data, of this thread at the bottom and of the emulation
+  // thread above
+  float* bars[] = {profiler_get_times(impl->profiler), impl->sys_times};
+  for (int bar = 0; bar < 2; bar++) {
+    dest.x = 0;
+    dest.y = impl->screen_rect->h - 6 * (bar + 1);
+    dest.h = 6;
+    for (int i = 0; i < PROFILER_NUM_POINTS; i++) {
+      dest.w = bars[bar][i] * 256;
+      SDL_SetRenderDrawColor(impl->renderer, PROFILER_COLOURS[i * 3],
+                             PROFILER_COLOURS[i * 3 + 1],
+                             PROFILER_COLOURS[i * 3 + 2], 0xFF);
+      SDL_RenderFillRect(impl->renderer, &dest);
+      dest.x += dest.w;
+    }
   }
 #endif
 
@@ -468,6 +496,44 @@ static void flip(front_sdl_impl_t* impl) {
   SDL_RenderClear(impl->renderer);
 }
 
+static void show_reports(front_sdl_impl_t* impl) {
+  front_sdl_emu_report_t report;
+  while (ring_pop(impl->emu->reports, &report, 1)) {
+    switch (report.status) {
+#ifdef PROFILER
+      case SS_NONE:
+        memcpy(impl->sys_times, report.times, sizeof(impl->sys_times));
+        break;
+#endif
+      case SS_ROM_MISSING:
+        display_message(impl, "No ROM loaded!");
+        break;
+      case SS_ROM_DAMAGED:
+        display_message(impl, "Invalid ROM file!");
+        break;
+      case SS_ROM_MAPPER:
+        display_message(impl, "Unsupported ROM mapper!");
+        break;
+      case SS_CPU_UNSUPPORTED_INSTRUCTION:
+        display_message(impl, UNSUPPORTED_INSTRUCTION_MESSAGE);
+        impl->message[2] = HEXADECIMAL[report.opcode >> 4];
+        impl->message[3] = HEXADECIMAL[report.opcode & 0xF];
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void audio_callback(void* userdata, Uint8* stream, int len) {
+  front_sdl_impl_t* impl = (front_sdl_impl_t*)userdata;
+  if (impl->emu == NULL) {
+    memset(stream, 0, len);
+    return;
+  }
+  front_sdl_emu_audio(impl->emu, stream, len / impl->emu->audio_sample_size);
+}
+
 /**
  * Public functions
  *
@@ -513,6 +579,9 @@ front_sdl_impl_t* front_sdl_impl_init(front_t* front) {
     front->sys->ppu->nes_palette_direct[i] =
         0xFF000000 | (r << 16) | (g << 8) | b;
   }
+  palette_init(&impl->palette, PF_ARGB8888,
+               front->sys->ppu->nes_palette_direct);
+  impl->frame = ppu_frame_acquire(front->sys->ppu);
 
   // Create window
   impl->window =
@@ -573,12 +642,25 @@ front_sdl_impl_t* front_sdl_impl_init(front_t* front) {
     return NULL;
   }
 
-  // Initialise audio
+  // Initialise audio, in the format of the APU output. The Raspberry Pi gets
+  // the cheapest resampler, and skips converting floats. Rate control keeps
+  // the queue to the audio callback short.
+#ifdef IS_PI
+  apu_output_t audio_output = {.rate = APU_ACTUAL_SAMPLE_RATE,
+                               .format = AF_S16,
+                               .quality = AQ_LOW};
+#else
+  apu_output_t audio_output = {.rate = APU_ACTUAL_SAMPLE_RATE,
+                               .format = AF_F32,
+                               .quality = AQ_MEDIUM};
+#endif
+  audio_output.queue_target = FRONT_SDL_EMU_AUDIO_TARGET;
+  apu_configure_output(front->sys->apu, &audio_output);
   SDL_AudioSpec audio_want, audio_have;
-  audio_want.freq = APU_ACTUAL_SAMPLE_RATE;
-  audio_want.format = AUDIO_F32;
+  audio_want.freq = audio_output.rate;
+  audio_want.format = audio_output.format == AF_S16 ? AUDIO_S16SYS : AUDIO_F32;
   audio_want.samples = AUDIO_BUFFER_SIZE;
-  audio_want.callback = NULL;
+  audio_want.callback = audio_callback;
   audio_want.channels = 1;
   audio_want.userdata = impl;
   impl->audio_device =
@@ -592,10 +674,13 @@ front_sdl_impl_t* front_sdl_impl_init(front_t* front) {
     free(impl);
     return NULL;
   }
-  // Enables queuing
+  // Starts the callback, which plays silence until emulation starts
+  impl->emu = NULL;
+  impl->pacing = FEP_TICKS;
   SDL_PauseAudioDevice(impl->audio_device, false);
 
   impl->front = front;
+  impl->profiler = profiler_init();
   preflip(impl);
 
   display_message(impl, "pines emulator initialised");
@@ -603,19 +688,24 @@ front_sdl_impl_t* front_sdl_impl_init(front_t* front) {
   return impl;
 }
 
-static void front_sdl_impl_audio_enqueue(void* context, apu_buffer_t* buffer,
-                                         int len);
-static apu_queued_size_t front_sdl_impl_audio_get_queue_size(void* context);
-
 void front_sdl_impl_run(front_sdl_impl_t* impl) {
   bool running = true;
   bool force_flip = false;
   uint32_t last_tick = SDL_GetTicks();
   sys_t* sys = impl->front->sys;
 
+  // The system belongs to the emulation thread from now on
+  front_sdl_emu_t* emu = front_sdl_emu_init(sys, impl->pacing);
+  if (emu == NULL) {
+    return;
+  }
+  SDL_LockAudioDevice(impl->audio_device);
+  impl->emu = emu;
+  SDL_UnlockAudioDevice(impl->audio_device);
+
   // Enter render loop, waiting for user to quit
   while (running) {
-    PROFILER_POINT(START)
+    PROFILER_POINT(impl->profiler, START)
 
     // Process SDL events
     SDL_Event event;
@@ -626,7 +716,7 @@ void front_sdl_impl_run(front_sdl_impl_t* impl) {
           break;
         case SDL_KEYDOWN:  // pass through
         case SDL_KEYUP:
-          controller_sdl_button(event);
+          front_sdl_emu_command(impl->emu, FEC_BUTTON, NULL, &event);
           break;
         case SDL_MOUSEMOTION:
           impl->mouse_x = event.motion.x / impl->front->scale;
@@ -646,37 +736,19 @@ void front_sdl_impl_run(front_sdl_impl_t* impl) {
                 // The dialog stalls SDL, don't count ticks
                 last_tick = SDL_GetTicks();
                 if (path != NULL) {
-                  sys_rom(sys, path);
-                  free(path);
-                  switch (sys->status) {
-                    case SS_ROM_DAMAGED:
-                      display_message(impl, "Invalid ROM file!");
-                      break;
-                    case SS_ROM_MAPPER:
-                      display_message(impl, "Unsupported ROM mapper!");
-                      break;
-                    default:
-                      break;
-                  }
+                  front_sdl_emu_command(impl->emu, FEC_LOAD, path, NULL);
                 }
               } break;
               case BUTTON_START:
                 SDL_PauseAudioDevice(impl->audio_device, false);
-                sys_start(sys);
-                switch (sys->status) {
-                  case SS_ROM_MISSING:
-                    display_message(impl, "No ROM loaded!");
-                    break;
-                  default:
-                    break;
-                }
+                front_sdl_emu_command(impl->emu, FEC_START, NULL, NULL);
                 break;
               case BUTTON_STOP:
                 SDL_PauseAudioDevice(impl->audio_device, true);
-                sys_stop(sys);
+                front_sdl_emu_command(impl->emu, FEC_STOP, NULL, NULL);
                 break;
               case BUTTON_PAUSE:
-                sys_pause(sys);
+                front_sdl_emu_command(impl->emu, FEC_PAUSE, NULL, NULL);
                 break;
               case BUTTON_CPU:
               case BUTTON_PPU:
@@ -691,7 +763,7 @@ void front_sdl_impl_run(front_sdl_impl_t* impl) {
                 }
                 break;
               case BUTTON_TEST:
-                sys_test(sys);
+                front_sdl_emu_command(impl->emu, FEC_TEST, NULL, NULL);
                 break;
               case BUTTON_ZOOM: {
                 if (impl->full) {
@@ -767,7 +839,7 @@ void front_sdl_impl_run(front_sdl_impl_t* impl) {
       }
     }
 
-    PROFILER_POINT(EVENTS)
+    PROFILER_POINT(impl->profiler, EVENTS)
 
     // Calculate time passed
     uint32_t this_tick = SDL_GetTicks();
@@ -783,28 +855,18 @@ void front_sdl_impl_run(front_sdl_impl_t* impl) {
       }
     }
 
-    PROFILER_POINT(TICKS)
-
-    // Run the system for the time passed and display graphics
-    if (sys_run(sys, ticks_passed, impl, front_sdl_impl_audio_enqueue,
-                front_sdl_impl_audio_get_queue_size)) {
-      // The system crashed
-      switch (sys->status) {
-        case SS_CPU_UNSUPPORTED_INSTRUCTION:
-          display_message(impl, UNSUPPORTED_INSTRUCTION_MESSAGE);
-          impl->message[2] = HEXADECIMAL[sys->cpu->last_opcode >> 4];
-          impl->message[3] = HEXADECIMAL[sys->cpu->last_opcode & 0xF];
-          break;
-        default:
-          break;
-      }
-    }
+    PROFILER_POINT(impl->profiler, TICKS)
 
-    if (sys->running &&
+    // Errors from the emulation thread
+    show_reports(impl);
+
+    if (front_sdl_emu_running(impl->emu) &&
         (impl->front->tab == FT_SCREEN || impl->front->tab == FT_PPU ||
          impl->front->tab == FT_APU || impl->front->tab == FT_IO)) {
-      // If the system is running, flip on demand
-      if (sys->ppu->flip || force_flip) {
+      // If the system is running, flip when a new frame is done. This never
+      // waits for the PPU, which is already drawing another frame.
+      impl->frame = ppu_frame_acquire(sys->ppu);
+      if (impl->frame->number != impl->frame_number || force_flip) {
         uint32_t* pixels;
         uint32_t pitch;
         preflip(impl);
@@ -812,14 +874,14 @@ void front_sdl_impl_run(front_sdl_impl_t* impl) {
                             (void*)&pitch)) {
           // printf("err: %s\n", SDL_GetError());
         } else {
-          memcpy(pixels, sys->ppu->screen, PPU_SCREEN_SIZE_BYTES);
+          palette_convert(&impl->palette, impl->frame, pixels, pitch);
           memset((uint8_t*)pixels + 240 * pitch, 0, 16 * pitch);
           SDL_UnlockTexture(impl->screen_tex);
           SDL_RenderCopy(impl->renderer, impl->screen_tex, NULL,
                          impl->screen_rect);
           flip(impl);
         }
-        sys->ppu->flip = false;
+        impl->frame_number = impl->frame->number;
       }
       SDL_Delay(2);
     } else {
@@ -829,21 +891,15 @@ void front_sdl_impl_run(front_sdl_impl_t* impl) {
       SDL_Delay(100);
     }
   }
-}
-
-static void front_sdl_impl_audio_enqueue(void* context, apu_buffer_t* buffer,
-                                         int len) {
-  front_sdl_impl_t* impl = (front_sdl_impl_t*)context;
-  SDL_ClearQueuedAudio(impl->audio_device);
-  SDL_QueueAudio(impl->audio_device, buffer, len * sizeof(apu_buffer_t));
-}
 
-static apu_queued_size_t front_sdl_impl_audio_get_queue_size(void* context) {
-  front_sdl_impl_t* impl = (front_sdl_impl_t*)context;
-  return SDL_GetQueuedAudioSize(impl->audio_device);
+  SDL_LockAudioDevice(impl->audio_device);
+  impl->emu = NULL;
+  SDL_UnlockAudioDevice(impl->audio_device);
+  front_sdl_emu_deinit(emu);
 }
 
 void front_sdl_impl_deinit(front_sdl_impl_t* impl) {
+  profiler_deinit(impl->profiler);
   SDL_DestroyTexture(impl->screen_tex);
   SDL_DestroyTexture(impl->ui);
   SDL_DestroyRenderer(impl->renderer);
@@ -0,0 +1,281 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "controller_sdl.h"
+#include "front_sdl_emu.h"
+#include "ring.h"
+#include "sys.h"
+
+/**
+ * front_sdl_emu.c
+ */
+
+/**
+ * Helper functions
+ *
+ * front_sdl_emu_report
+ *   Queues a report for the UI thread.
+ *
+ * front_sdl_emu_report_times
+ *   Queues a copy of the profile of the system for the UI thread, whenever the
+ *   profiler has a new average.
+ *
+ * front_sdl_emu_audio_enqueue
+ *   Audio callback of the system, queues the samples for the audio callback.
+ *
+ * front_sdl_emu_audio_get_queue_size
+ *   Audio callback of the system, returns the size of the audio queue.
+ *
+ * front_sdl_emu_audio_ticks
+ *   Returns the ms to run for the audio queue to reach its target fill.
+ *
+ * front_sdl_emu_execute
+ *   Executes a command. Returns false if the thread has to end.
+ *
+ * front_sdl_emu_thread
+ *   Main loop of the emulation thread.
+ */
+static void front_sdl_emu_report(front_sdl_emu_t* emu, sys_status_t status) {
+  front_sdl_emu_report_t report = {.status = status,
+                                   .opcode = emu->sys->cpu->last_opcode};
+  ring_push(emu->reports, &report, 1);
+}
+
+#ifdef PROFILER
+static void front_sdl_emu_report_times(front_sdl_emu_t* emu) {
+  profiler_t* profiler = emu->sys->profiler;
+  float* times = profiler_get_times(profiler);
+  if (profiler->samples == 0) {
+    front_sdl_emu_report_t report = {.status = SS_NONE};
+    memcpy(report.times, times, sizeof(report.times));
+    ring_push(emu->reports, &report, 1);
+  }
+}
+#endif
+
+static void front_sdl_emu_audio_enqueue(void* context, const void* samples,
+                                        int len) {
+  front_sdl_emu_t* emu = (front_sdl_emu_t*)context;
+  if (ring_push(emu->audio, samples, len) < (uint32_t)len) {
+    __atomic_add_fetch(&emu->audio_overruns, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static apu_queued_size_t front_sdl_emu_audio_get_queue_size(void* context) {
+  front_sdl_emu_t* emu = (front_sdl_emu_t*)context;
+  return ring_size(emu->audio) * emu->audio_sample_size;
+}
+
+static uint32_t front_sdl_emu_audio_ticks(front_sdl_emu_t* emu) {
+  apu_t* apu = emu->sys->apu;
+  // Including the samples the APU has yet to enqueue
+  uint32_t queued = ring_size(emu->audio) + apu->buffer_cursor;
+  if (queued >= apu->config.queue_target) {
+    return 0;
+  }
+  uint32_t missing = apu->config.queue_target - queued;
+  return (missing * 1000 + apu->config.rate - 1) / apu->config.rate;
+}
+
+static bool front_sdl_emu_execute(front_sdl_emu_t* emu,
+                                  front_sdl_emu_command_t* command) {
+  sys_t* sys = emu->sys;
+  switch (command->type) {
+    case FEC_LOAD:
+      if (sys_rom(sys, command->path) != SS_NONE) {
+        front_sdl_emu_report(emu, sys->status);
+      }
+      free(command->path);
+      break;
+    case FEC_START:
+      sys_start(sys);
+      if (sys->status == SS_ROM_MISSING) {
+        front_sdl_emu_report(emu, sys->status);
+      }
+      break;
+    case FEC_STOP:
+      sys_stop(sys);
+      break;
+    case FEC_PAUSE:
+      sys_pause(sys);
+      break;
+    case FEC_TEST:
+      sys_test(sys);
+      break;
+    case FEC_BUTTON:
+      controller_sdl_button(sys->controller, command->event);
+      break;
+    case FEC_QUIT:
+      return false;
+  }
+  return true;
+}
+
+static int front_sdl_emu_thread(void* data) {
+  front_sdl_emu_t* emu = (front_sdl_emu_t*)data;
+  sys_t* sys = emu->sys;
+  uint32_t last_tick = SDL_GetTicks();
+  bool quit = false;
+
+  while (!quit) {
+    SDL_LockMutex(emu->lock);
+
+    front_sdl_emu_command_t command;
+    while (!quit && ring_pop(emu->commands, &command, 1)) {
+      quit = !front_sdl_emu_execute(emu, &command);
+    }
+
+    // Run the system for the time passed, or for as long as the audio
+    // callback has to be fed. The latter follows the clock of the audio
+    // device, rate control keeps the emulation from drifting off either.
+    uint32_t this_tick = SDL_GetTicks();
+    uint32_t ticks_passed = this_tick - last_tick;
+    last_tick = this_tick;
+    if (emu->pacing == FEP_AUDIO) {
+      ticks_passed = front_sdl_emu_audio_ticks(emu);
+    }
+    if (ticks_passed > FRONT_SDL_EMU_MAX_TICKS) {
+      ticks_passed = FRONT_SDL_EMU_MAX_TICKS;
+    }
+    if (sys_run(sys, ticks_passed, emu, &front_sdl_emu_audio_enqueue,
+                &front_sdl_emu_audio_get_queue_size)) {
+      front_sdl_emu_report(emu, sys->status);
+    }
+#ifdef PROFILER
+    if (sys->running) {
+      front_sdl_emu_report_times(emu);
+    }
+#endif
+    // Nothing else presents frames, the controllers are polled once per frame
+    sys->ppu->flip = false;
+    __atomic_store_n(&emu->running, sys->running, __ATOMIC_RELEASE);
+    __atomic_store_n(&emu->status, sys->status, __ATOMIC_RELEASE);
+
+    SDL_UnlockMutex(emu->lock);
+    SDL_Delay(1);
+  }
+  return 0;
+}
+
+/**
+ * Public functions
+ *
+ * See front_sdl_emu.h for descriptions.
+ */
+front_sdl_emu_t* front_sdl_emu_init(sys_t* sys,
+                                    front_sdl_emu_pacing_t pacing) {
+  front_sdl_emu_t* emu = malloc(sizeof(front_sdl_emu_t));
+  emu->sys = sys;
+  emu->pacing = pacing;
+  emu->lock = SDL_CreateMutex();
+  emu->commands =
+      ring_init(FRONT_SDL_EMU_COMMANDS, sizeof(front_sdl_emu_command_t));
+  emu->reports =
+      ring_init(FRONT_SDL_EMU_REPORTS, sizeof(front_sdl_emu_report_t));
+  emu->audio_sample_size = apu_sample_size(sys->apu->config.format);
+  emu->audio = ring_init(FRONT_SDL_EMU_AUDIO, emu->audio_sample_size);
+  memset(emu->audio_last, 0, sizeof(emu->audio_last));
+  emu->audio_overruns = 0;
+  emu->audio_underruns = 0;
+  emu->running = sys->running;
+  emu->status = sys->status;
+  emu->thread = SDL_CreateThread(&front_sdl_emu_thread, "emulation", emu);
+  if (emu->thread == NULL) {
+    fprintf(stderr, "Could not start emulation thread, %s\n", SDL_GetError());
+    ring_deinit(emu->audio);
+    ring_deinit(emu->reports);
+    ring_deinit(emu->commands);
+    SDL_DestroyMutex(emu->lock);
+    free(emu);
+    return NULL;
+  }
+  return emu;
+}
+
+bool front_sdl_emu_command(front_sdl_emu_t* emu,
+                           front_sdl_emu_command_type_t type, char* path,
+                           SDL_Event* event) {
+  front_sdl_emu_command_t command = {.type = type, .path = path};
+  if (event != NULL) {
+    command.event = *event;
+  }
+  if (!ring_push(emu->commands, &command, 1)) {
+    free(path);
+    return false;
+  }
+  return true;
+}
+
+bool front_sdl_emu_running(front_sdl_emu_t* emu) {
+  return __atomic_load_n(&emu->running, __ATOMIC_ACQUIRE);
+}
+
+sys_status_t front_sdl_emu_status(front_sdl_emu_t* emu) {
+  return __atomic_load_n(&emu->status, __ATOMIC_ACQUIRE);
+}
+
+void front_sdl_emu_audio(front_sdl_emu_t* emu, void* buffer, uint32_t len) {
+  uint8_t* bytes = (uint8_t*)buffer;
+  uint32_t size = emu->audio_sample_size;
+  uint32_t popped = ring_pop(emu->audio, buffer, len);
+  if (popped > 0) {
+    memcpy(emu->audio_last, bytes + (popped - 1) * size, size);
+  }
+  if (popped < len) {
+    for (uint32_t i = popped; i < len; i++) {
+      memcpy(bytes + i * size, emu->audio_last, size);
+    }
+    // A paused system is expected to leave the queue empty
+    if (front_sdl_emu_running(emu)) {
+      __atomic_add_fetch(&emu->audio_underruns, 1, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+void front_sdl_emu_audio_stats(front_sdl_emu_t* emu,
+                               front_sdl_emu_audio_stats_t* stats) {
+  stats->queued = ring_size(emu->audio);
+  stats->overruns = __atomic_load_n(&emu->audio_overruns, __ATOMIC_RELAXED);
+  stats->underruns = __atomic_load_n(&emu->audio_underruns, __ATOMIC_RELAXED);
+}
+
+void front_sdl_emu_deinit(front_sdl_emu_t* emu) {
+  // Retried, the thread empties the queue within a millisecond
+  while (!front_sdl_emu_command(emu, FEC_QUIT, NULL, NULL)) {
+    SDL_Delay(1);
+  }
+  SDL_WaitThread(emu->thread, NULL);
+  ring_deinit(emu->audio);
+  ring_deinit(emu->reports);
+  ring_deinit(emu->commands);
+  SDL_DestroyMutex(emu->lock);
+  free(emu);
+}
@@ -30,7 +30,7 @@
 #define NROM128_SIZE 0x4000
 
 // Mapper 0
-static void mapper000_init(mapper_special_t* self, mapper_t* mapper) {
+static void mapper000_init(const mapper_special_t* self, mapper_t* mapper) {
   size_t size = rom_get_prg_rom_size(mapper);
   if (size == NROM256_SIZE) {
     // NROM256 does not mirror (default).
@@ -42,42 +42,42 @@ static void mapper000_init(mapper_special_t* self, mapper_t* mapper) {
   }
 }
 
-static void mapper000_deinit(mapper_special_t* self, mapper_t* mapper) {}
+static void mapper000_deinit(const mapper_special_t* self, mapper_t* mapper) {}
 
-static void mapper000_cpu_write(mapper_special_t* self, mapper_t* mapper,
+static void mapper000_cpu_write(const mapper_special_t* self, mapper_t* mapper,
                                 uint16_t address, uint8_t val) {}
 
-static uint8_t mapper000_cpu_read(mapper_special_t* self, mapper_t* mapper,
-                                  uint16_t address) {
+static uint8_t mapper000_cpu_read(const mapper_special_t* self,
+                                  mapper_t* mapper, uint16_t address) {
   return 0;
 }
 
-static void mapper000_ppu_write(mapper_special_t* self, mapper_t* mapper,
+static void mapper000_ppu_write(const mapper_special_t* self, mapper_t* mapper,
                                 uint16_t address, uint8_t val) {}
 
-static uint8_t mapper000_ppu_read(mapper_special_t* self, mapper_t* mapper,
-                                  uint16_t address) {
+static uint8_t mapper000_ppu_read(const mapper_special_t* self,
+                                  mapper_t* mapper, uint16_t address) {
   return 0;
 }
 
 // Mapper 1
-static void mapper001_init(mapper_special_t* self, mapper_t* mapper) {}
+static void mapper001_init(const mapper_special_t* self, mapper_t* mapper) {}
 
-static void mapper001_deinit(mapper_special_t* self, mapper_t* mapper) {}
+static void mapper001_deinit(const mapper_special_t* self, mapper_t* mapper) {}
 
-static void mapper001_cpu_write(mapper_special_t* self, mapper_t* mapper,
+static void mapper001_cpu_write(const mapper_special_t* self, mapper_t* mapper,
                                 uint16_t address, uint8_t val) {}
 
-static uint8_t mapper001_cpu_read(mapper_special_t* self, mapper_t* mapper,
-                                  uint16_t address) {
+static uint8_t mapper001_cpu_read(const mapper_special_t* self,
+                                  mapper_t* mapper, uint16_t address) {
   return 0;
 }
 
-static void mapper001_ppu_write(mapper_special_t* self, mapper_t* mapper,
+static void mapper001_ppu_write(const mapper_special_t* self, mapper_t* mapper,
                                 uint16_t address, uint8_t val) {}
 
-static uint8_t mapper001_ppu_read(mapper_special_t* self, mapper_t* mapper,
-                                  uint16_t address) {
+static uint8_t mapper001_ppu_read(const mapper_special_t* self,
+                                  mapper_t* mapper, uint16_t address) {
   return 0;
 }
 
@@ -130,7 +130,7 @@ typedef struct {
   bool irq_enable;
 } mapper004_t;
 
-static void mapper004_init(mapper_special_t* self, mapper_t* mapper) {
+static void mapper004_init(const mapper_special_t* self, mapper_t* mapper) {
   /**
    * PRG & CHR ROM and RAM are freed for us.
    * CHR ROM: 8K + 8K + 16K fixed.
@@ -146,23 +146,25 @@ static void mapper004_init(mapper_special_t* self, mapper_t* mapper) {
   mapper004_t* data = calloc(1, sizeof(mapper004_t));
   data->ram_protect.data.enable_prg_ram = 1;
   data->mirroring.data.is_horizontal = !mapper->header->flags6.data.mirroring;
-  self->data = data;
+  mapper->data = data;
 }
 
-static void mapper004_deinit(mapper_special_t* self, mapper_t* mapper) {
-  free(self->data);
-  self->data = NULL;
+static void mapper004_deinit(const mapper_special_t* self, mapper_t* mapper) {
+  free(mapper->data);
+  mapper->data = NULL;
 }
 
-static void mapper004_cpu_write(mapper_special_t* self, mapper_t* mapper,
-                                uint16_t address, uint8_t val) {
+static void mapper004_cpu_write(const mapper_special_t* self,
+                                mapper_t* mapper, uint16_t address,
+                                uint8_t val) {
+  mapper004_t* data = (mapper004_t*)mapper->data;
   if (address >= 0x8000 && address <= 0x9FFF) {
     // Bank Select, $8000 - $9FFE (even)
     if (address % 2 == 0) {
-      ((mapper004_t*)self->data)->bank_select.raw = val;
+      data->bank_select.raw = val;
     } else {
       // Bank Data, $8001-$9FFF (odd)
-      ((mapper004_t*)self->data)->bank_data.raw = val;
+      data->bank_data.raw = val;
     }
   }
 
@@ -170,40 +172,40 @@ static void mapper004_cpu_write(mapper_special_t* self, mapper_t* mapper,
     if (address % 2 == 0) {
       // Mirroring, $A000-$BFFE (even)
       // Unused (we use the iNES/NES2.0 values)
-      ((mapper004_t*)self->data)->mirroring.raw = val;
+      data->mirroring.raw = val;
     } else {
       // PRG RAM protect, $A001-BFFF (odd)
-      ((mapper004_t*)self->data)->ram_protect.raw = val;
+      data->ram_protect.raw = val;
     }
   }
 
   if (address >= 0xC000 && address <= 0xDFFF) {
     if (address % 2 == 0) {
       // IRQ latch, $C000-$DFFE (even)
-      ((mapper004_t*)self->data)->irq_latch = val;
+      data->irq_latch = val;
     } else {
       // IRQ reload, $C001-$DFFF (odd)
-      ((mapper004_t*)self->data)->irq_reload = true;
+      data->irq_reload = true;
     }
   }
 
   if (address >= 0xE000 && address <= 0xFFFF) {
     // IRQ disable, $E000-$FFFE (even)
     // IRQ enable, $E001-$FFF (odd)
-    ((mapper004_t*)self->data)->irq_enable = address % 2 != 0;
+    data->irq_enable = address % 2 != 0;
   }
 }
 
-static uint8_t mapper004_cpu_read(mapper_special_t* self, mapper_t* mapper,
-                                  uint16_t address) {
+static uint8_t mapper004_cpu_read(const mapper_special_t* self,
+                                  mapper_t* mapper, uint16_t address) {
   return 0;
 }
 
-static void mapper004_ppu_write(mapper_special_t* self, mapper_t* mapper,
+static void mapper004_ppu_write(const mapper_special_t* self, mapper_t* mapper,
                                 uint16_t address, uint8_t val) {}
 
-static uint8_t mapper004_ppu_read(mapper_special_t* self, mapper_t* mapper,
-                                  uint16_t address) {
+static uint8_t mapper004_ppu_read(const mapper_special_t* self,
+                                  mapper_t* mapper, uint16_t address) {
   return 0;
 }
 
@@ -214,13 +216,13 @@ static uint8_t mapper004_ppu_read(mapper_special_t* self, mapper_t* mapper,
     .cpu_write = &mapper##NUMBER##_cpu_write,                             \
     .cpu_read = &mapper##NUMBER##_cpu_read,                               \
     .ppu_write = &mapper##NUMBER##_ppu_write,                             \
-    .ppu_read = &mapper##NUMBER##_ppu_read, .present = true, .data = NULL \
+    .ppu_read = &mapper##NUMBER##_ppu_read, .present = true \
   }
 #define NOMAPPER                                                        \
   {                                                                     \
     .mapper_init = NULL, .cpu_write = NULL, .cpu_read = NULL,           \
-    .ppu_write = NULL, .ppu_read = NULL, .present = false, .data = NULL \
+    .ppu_write = NULL, .ppu_read = NULL, .present = false \
   }
 
-mapper_special_t MAPPERS[NUM_MAPPERS] = {MAPPER(000), MAPPER(001), NOMAPPER,
-                                         NOMAPPER, MAPPER(004)};
+const mapper_special_t MAPPERS[NUM_MAPPERS] = {
+    MAPPER(000), MAPPER(001), NOMAPPER, NOMAPPER, MAPPER(004)};
@@ -25,9 +25,12 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "apu.h"
 #include "error.h"
 #include "front.h"
 #include "front_impl.h"
@@ -43,18 +46,47 @@
 
 int main(int argc, char** argv) {
   bool preload_rom = false;
+#ifdef HEADLESS
+  uint32_t frames = FRONT_HEADLESS_DEFAULT_FRAMES;
+  uint32_t render_every = 1;
+  const char* screen_path = NULL;
+  const char* audio_path = NULL;
+  apu_output_t audio_output = {.rate = APU_ACTUAL_SAMPLE_RATE,
+                               .format = AF_F32,
+                               .quality = AQ_HIGH};
+#else
+  front_sdl_emu_pacing_t pacing = FEP_TICKS;
+#endif
 
   // Parse arguments
   if (argc > 1) {
     if (!strcmp(argv[1], "-?") || !strcmp(argv[1], "-h") ||
         !strcmp(argv[1], "--help")) {
       printf("usage:\n");
+#ifdef HEADLESS
+      printf("  build/nes <rom path> [-f frames] [-k n] [-s screen.ppm] "
+             "[-a audio.wav]\n");
+      printf("            [-r rate] [-b 16|32] [-q low|medium|high]\n");
+      printf("    - runs the given ROM for a number of frames (default %d)\n",
+             FRONT_HEADLESS_DEFAULT_FRAMES);
+      printf("      as fast as possible, then exits\n");
+      printf("    - -k only draws every nth frame and the last one\n");
+      printf("    - -s writes the last frame to a PPM file\n");
+      printf("    - -a writes the audio output to a WAV file, at the given\n");
+      printf("      sample rate (default %d), as 16 bit integers or 32 bit\n",
+             APU_ACTUAL_SAMPLE_RATE);
+      printf("      floats (default) and with the given resampler quality\n");
+      printf("      (default high)\n\n");
+#else
       printf("  build/nes\n");
       printf("    - runs the emulator with no ROM preloaded\n\n");
-      printf("  build/nes <rom path>\n");
+      printf("  build/nes <rom path> [-p ticks|audio]\n");
       printf("    - runs the emulator with the given ROM preloaded,\n");
       printf("      and the system automatically initialised\n");
-      printf("    - if <rom path> does not exist, exits immediately\n\n");
+      printf("    - if <rom path> does not exist, exits immediately\n");
+      printf("    - -p paces the emulation by the system clock (default)\n");
+      printf("      or by the demand of the audio device\n\n");
+#endif
       return EXIT_SUCCESS;
     }
     // Check for read permission (thus also existence) of ROM
@@ -66,6 +98,85 @@ int main(int argc, char** argv) {
     preload_rom = true;
   }
 
+#ifdef HEADLESS
+  if (!preload_rom) {
+    fprintf(stderr, "a ROM file is required\n");
+    fprintf(stderr, "(build/nes --help for usage info)\n");
+    return EXIT_FAILURE;
+  }
+  for (int i = 2; i < argc; i++) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    if (!strcmp(argv[i], "-f")) {
+      frames = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "-k")) {
+      render_every = strtoul(argv[++i], NULL, 10);
+      if (render_every == 0) {
+        fprintf(stderr, "-k needs a positive value\n");
+        return EXIT_FAILURE;
+      }
+    } else if (!strcmp(argv[i], "-s")) {
+      screen_path = argv[++i];
+    } else if (!strcmp(argv[i], "-a")) {
+      audio_path = argv[++i];
+    } else if (!strcmp(argv[i], "-r")) {
+      audio_output.rate = strtoul(argv[++i], NULL, 10);
+      if (audio_output.rate < 8000 || audio_output.rate > 96000) {
+        fprintf(stderr, "-r needs a rate from 8000 to 96000\n");
+        return EXIT_FAILURE;
+      }
+    } else if (!strcmp(argv[i], "-b")) {
+      i++;
+      if (!strcmp(argv[i], "16")) {
+        audio_output.format = AF_S16;
+      } else if (!strcmp(argv[i], "32")) {
+        audio_output.format = AF_F32;
+      } else {
+        fprintf(stderr, "-b needs 16 or 32\n");
+        return EXIT_FAILURE;
+      }
+    } else if (!strcmp(argv[i], "-q")) {
+      i++;
+      if (!strcmp(argv[i], "low")) {
+        audio_output.quality = AQ_LOW;
+      } else if (!strcmp(argv[i], "medium")) {
+        audio_output.quality = AQ_MEDIUM;
+      } else if (!strcmp(argv[i], "high")) {
+        audio_output.quality = AQ_HIGH;
+      } else {
+        fprintf(stderr, "-q needs low, medium or high\n");
+        return EXIT_FAILURE;
+      }
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+#else
+  for (int i = 2; i < argc; i++) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    if (!strcmp(argv[i], "-p")) {
+      i++;
+      if (!strcmp(argv[i], "ticks")) {
+        pacing = FEP_TICKS;
+      } else if (!strcmp(argv[i], "audio")) {
+        pacing = FEP_AUDIO;
+      } else {
+        fprintf(stderr, "-p needs ticks or audio\n");
+        return EXIT_FAILURE;
+      }
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+#endif
+
   // Initialise the system
   sys_t* sys = sys_init();
 
@@ -85,6 +196,15 @@ int main(int argc, char** argv) {
     sys_deinit(sys);
     return EXIT_FAILURE;
   }
+#ifdef HEADLESS
+  impl->frames = frames;
+  impl->render_every = render_every;
+  impl->screen_path = screen_path;
+  impl->audio_path = audio_path;
+  impl->audio_output = audio_output;
+#else
+  impl->pacing = pacing;
+#endif
 
   // Load ROM if provided
   if (preload_rom) {
@@ -0,0 +1,146 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "palette.h"
+
+/**
+ * palette.c
+ */
+
+// Share of its intensity a colour channel keeps for every emphasis bit that
+// selects another channel
+#define PALETTE_EMPHASIS_ATTENUATION 0.816
+
+/**
+ * Helper functions
+ *
+ * palette_colour
+ *   Converts a colour to the pixel format.
+ *
+ * palette_row_32
+ *   Converts a row of the screen to a 32 bit format.
+ *
+ * palette_row_16
+ *   Converts a row of the screen to a 16 bit format.
+ *
+ * palette_row_yuy2
+ *   Converts a row of the screen to YUY2.
+ */
+static uint32_t palette_colour(palette_format_t format, uint8_t r, uint8_t g,
+                               uint8_t b) {
+  switch (format) {
+    case PF_ARGB8888:
+      return 0xFF000000 | (r << 16) | (g << 8) | b;
+    case PF_RGB565:
+      return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    case PF_YUY2: {
+      // BT.601, limited range, offset to keep the sums positive
+      uint32_t y = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+      uint32_t u = (-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8;
+      uint32_t v = (112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8;
+      return y | (u << 8) | (v << 16);
+    }
+  }
+  return 0;
+}
+
+// The colours are looked up 8 at a time, so that the compiler can keep the
+// loads independent and vectorise the stores
+static void palette_row_32(const uint32_t* colours, const uint8_t* in,
+                           uint32_t* out) {
+  for (uint16_t x = 0; x < PPU_SCREEN_WIDTH; x += 8) {
+    for (uint8_t i = 0; i < 8; i++) {
+      out[x + i] = colours[in[x + i]];
+    }
+  }
+}
+
+static void palette_row_16(const uint32_t* colours, const uint8_t* in,
+                           uint16_t* out) {
+  for (uint16_t x = 0; x < PPU_SCREEN_WIDTH; x += 8) {
+    for (uint8_t i = 0; i < 8; i++) {
+      out[x + i] = colours[in[x + i]];
+    }
+  }
+}
+
+static void palette_row_yuy2(const uint32_t* colours, const uint8_t* in,
+                             uint8_t* out) {
+  for (uint16_t x = 0; x < PPU_SCREEN_WIDTH; x += 2) {
+    uint32_t left = colours[in[x]];
+    uint32_t right = colours[in[x + 1]];
+    out[x * 2] = left;
+    out[x * 2 + 1] = (((left >> 8) & 0xFF) + ((right >> 8) & 0xFF) + 1) >> 1;
+    out[x * 2 + 2] = right;
+    out[x * 2 + 3] = ((left >> 16) + (right >> 16) + 1) >> 1;
+  }
+}
+
+/**
+ * Public functions
+ *
+ * See palette.h for descriptions.
+ */
+void palette_init(palette_t* palette, palette_format_t format,
+                  const uint32_t* argb) {
+  palette->format = format;
+  for (uint8_t emphasis = 0; emphasis < PPU_EMPHASIS_COUNT; emphasis++) {
+    // Emphasis bits select red, green and blue, in that order
+    double scale[3] = {1, 1, 1};
+    for (uint8_t channel = 0; channel < 3; channel++) {
+      for (uint8_t bit = 0; bit < 3; bit++) {
+        if (bit != channel && (emphasis >> bit) & 1) {
+          scale[channel] *= PALETTE_EMPHASIS_ATTENUATION;
+        }
+      }
+    }
+    for (uint8_t i = 0; i < 64; i++) {
+      uint8_t r = ((argb[i] >> 16) & 0xFF) * scale[0];
+      uint8_t g = ((argb[i] >> 8) & 0xFF) * scale[1];
+      uint8_t b = (argb[i] & 0xFF) * scale[2];
+      palette->colours[emphasis][i] = palette_colour(format, r, g, b);
+    }
+  }
+}
+
+void palette_convert(const palette_t* palette, const ppu_frame_t* frame,
+                     void* pixels, int pitch) {
+  for (uint16_t y = 0; y < PPU_SCREEN_HEIGHT; y++) {
+    const uint32_t* colours = palette->colours[frame->emphasis[y]];
+    const uint8_t* in = frame->screen + y * PPU_SCREEN_WIDTH;
+    uint8_t* out = (uint8_t*)pixels + y * pitch;
+    switch (palette->format) {
+      case PF_ARGB8888:
+        palette_row_32(colours, in, (uint32_t*)out);
+        break;
+      case PF_RGB565:
+        palette_row_16(colours, in, (uint16_t*)out);
+        break;
+      case PF_YUY2:
+        palette_row_yuy2(colours, in, out);
+        break;
+    }
+  }
+}
@@ -28,6 +28,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) && !defined(NO_SIMD)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && !defined(NO_SIMD)
+#include <arm_neon.h>
+#endif
+
 #include "ppu.h"
 #include "profiler.h"
 
@@ -54,16 +60,51 @@
  *   Reads an attribute table entry.
  *
  * ppu_cycle_bg_low
- *   Reads the low byte of a BG tile.
+ *   Reads the low byte of a BG tile, decoded.
  *
  * ppu_cycle_bg_high
- *   Reads the high byte of a BG tile.
+ *   Reads the high byte of a BG tile, decoded.
  *
  * ppu_cycle_tile
- *   Combines attributes, low and high bytes of tile.
+ *   Combines attributes and the decoded tile.
  *
  * ppu_fetch_sprite
  *   Fetches and decodes a sprite from the OAM.
+ *
+ * ppu_oam_index_sprite
+ *   Adds or removes an OAM entry in the scanline index.
+ *
+ * ppu_oam_index
+ *   Rebuilds the scanline index for the whole OAM.
+ *
+ * ppu_cycle_eval
+ *   Evaluates whether the given OAM entry is on the next scanline.
+ *
+ * ppu_cycle_sprite_clear
+ *   Clears the sprite line buffer before the sprite fetches.
+ *
+ * ppu_cycle_sprite
+ *   Fetches the next sprite found by the evaluation, and draws it into the
+ *   line buffer for the next scanline.
+ *
+ * ppu_cycle_inc_hori
+ *   Increments hori(v).
+ *
+ * ppu_cycle_inc_vert
+ *   Increments vert(v).
+ *
+ * ppu_cycle_copy_hori
+ *   Copies hori(t) to hori(v).
+ *
+ * ppu_render_pixel
+ *   Composites the background and sprites for a visible dot, and outputs the
+ *   pixel if rendering.
+ *
+ * ppu_render_backdrop
+ *   Outputs the backdrop colour for visible dots with rendering disabled.
+ *
+ * ppu_frame_publish
+ *   Publishes the frame just drawn, and starts drawing into another one.
  */
 static uint32_t mmap(ppu_t* ppu, uint32_t address) {
   address &= 0x3FFF;
@@ -106,23 +147,17 @@ static void ppu_cycle_fetch_at(ppu_t* ppu, bool garbage) {
 static void ppu_cycle_bg_low(ppu_t* ppu) {
   ppu->io_addr = 0x1000 * (uint16_t)(ppu->ctrl_bg_table) +
                  16 * (uint16_t)(ppu->ren_nt) + ppu->v.scroll.y_fine;
-  ppu->ren_bg_low = mmap(ppu, ppu->io_addr);
+  ppu->ren_bg = mmap_ppu_pattern(ppu->mapper, ppu->io_addr, false);
 }
 
 static void ppu_cycle_bg_high(ppu_t* ppu) {
   ppu->io_addr = 0x1000 * (uint16_t)(ppu->ctrl_bg_table) +
                  16 * (uint16_t)(ppu->ren_nt) + ppu->v.scroll.y_fine;
-  ppu->ren_bg_high = mmap(ppu, ppu->io_addr + 8);
+  ppu->ren_bg |= mmap_ppu_pattern(ppu->mapper, ppu->io_addr + 8, false) << 1;
 }
 
 static void ppu_cycle_tile(ppu_t* ppu) {
-  uint32_t data = 0;
-  for (uint8_t i = 0; i < 8; i++) {
-    data <<= 4;
-    data |= ((ppu->ren_bg_low << i) & 0x80) >> 7;
-    data |= ((ppu->ren_bg_high << i) & 0x80) >> 6;
-  }
-  data |= ppu->ren_at * 0x44444444;
+  uint32_t data = ppu->ren_bg | ppu->ren_at * 0x44444444;
   ppu->tile_data |= (uint64_t)data;
 }
 
@@ -145,24 +180,439 @@ static uint32_t ppu_fetch_sprite(ppu_t* ppu, uint8_t i, uint16_t row) {
     }
   }
   addr = 0x1000 * ((uint16_t)bank) + 0x10 * ((uint16_t)tile) + ((uint16_t)row);
-  ppu->ren_bg_low = mmap(ppu, addr);
-  ppu->ren_bg_high = mmap(ppu, addr + 8);
-  uint32_t data = 0;
-  if (attr.attr.flip_h) {
-    for (uint8_t i = 0; i < 8; i++) {
-      data <<= 4;
-      data |= ((ppu->ren_bg_low >> i) & 1);
-      data |= ((ppu->ren_bg_high >> i) & 1) << 1;
+  uint32_t data = mmap_ppu_pattern(ppu->mapper, addr, attr.attr.flip_h);
+  data |= mmap_ppu_pattern(ppu->mapper, addr + 8, attr.attr.flip_h) << 1;
+  data |= attr.attr.palette * 0x44444444;
+  return data;
+}
+
+static void ppu_oam_index_sprite(ppu_t* ppu, uint8_t i, bool add) {
+  uint64_t bit = (uint64_t)1 << i;
+  uint16_t y = ppu->oam.sprites[i].y;
+  for (uint16_t line = y; line < y + ppu->sprite_size; line++) {
+    if (line >= PPU_SCREEN_HEIGHT) {
+      break;
+    }
+    if (add) {
+      ppu->oam_lines[line] |= bit;
+    } else {
+      ppu->oam_lines[line] &= ~bit;
     }
+  }
+}
+
+static void ppu_oam_index(ppu_t* ppu) {
+  memset(ppu->oam_lines, 0, sizeof(ppu->oam_lines));
+  for (uint8_t i = 0; i < 64; i++) {
+    ppu_oam_index_sprite(ppu, i, true);
+  }
+}
+
+static void ppu_cycle_eval(ppu_t* ppu, uint8_t i) {
+  if (ppu->spr_count_next < 9 && (ppu->oam_lines[ppu->scanline] >> i) & 1) {
+    if (ppu->spr_count_next < 8) {
+      oam_attr_t attr = {.raw = ppu->oam.sprites[i].attr};
+      ppu->spr_row_next[ppu->spr_count_next] =
+          ppu->scanline - ppu->oam.sprites[i].y;
+      ppu->spr_pos_next[ppu->spr_count_next] = ppu->oam.sprites[i].x;
+      ppu->spr_priority_next[ppu->spr_count_next] = attr.attr.priority;
+      ppu->spr_index_next[ppu->spr_count_next] = i;
+      ppu->spr_count_next++;
+    } else {
+      ppu->status_overflow = true;
+    }
+  }
+}
+
+static void ppu_cycle_sprite_clear(ppu_t* ppu) {
+  ppu->spr_count = 0;
+  ppu->spr_line_zero = false;
+  memset(ppu->spr_line, 0, sizeof(ppu->spr_line));
+}
+
+static void ppu_cycle_sprite(ppu_t* ppu) {
+  uint16_t n = ppu->spr_count;
+  if (n < 8 && n < ppu->spr_count_next) {
+    uint32_t pattern =
+        ppu_fetch_sprite(ppu, ppu->spr_index_next[n], ppu->spr_row_next[n]);
+    uint8_t flags = ppu->spr_priority_next[n] ? PPU_SPR_PRIORITY : 0;
+    if (ppu->spr_index_next[n] == 0) {
+      flags |= PPU_SPR_SPRITE0;
+      ppu->spr_line_zero = true;
+    } else if (!ppu->render) {
+      // Only sprite 0 has visible effects when not rendering
+      ppu->spr_count++;
+      return;
+    }
+    // Sprites are fetched front to back, earlier opaque pixels stay
+    uint8_t* line = ppu->spr_line + ppu->spr_pos_next[n];
+    uint16_t width = PPU_SCREEN_WIDTH - ppu->spr_pos_next[n];
+    for (uint8_t i = 0; i < 8 && i < width; i++) {
+      uint8_t pixel = (pattern >> ((7 - i) * 4)) & 0x0F;
+      if ((pixel & 3) && !(line[i] & 3)) {
+        line[i] = pixel | flags;
+      }
+    }
+    ppu->spr_count++;
+  }
+}
+
+static void ppu_cycle_inc_hori(ppu_t* ppu) {
+  if (ppu->v.scroll.x_coarse < 31) {
+    ppu->v.scroll.x_coarse++;
+  } else {
+    ppu->v.scroll.x_coarse = 0;
+    ppu->v.scroll.nx = 1 - ppu->v.scroll.nx;
+  }
+}
+
+static void ppu_cycle_inc_vert(ppu_t* ppu) {
+  if (ppu->v.scroll.y_fine < 7) {
+    ppu->v.scroll.y_fine++;
   } else {
-    for (uint8_t i = 0; i < 8; i++) {
-      data <<= 4;
-      data |= ((ppu->ren_bg_low << i) & 0x80) >> 7;
-      data |= ((ppu->ren_bg_high << i) & 0x80) >> 6;
+    ppu->v.scroll.y_fine = 0;
+    uint8_t y = ppu->v.scroll.y_coarse;
+    if (y == 29) {
+      y = 0;
+      ppu->v.scroll.ny = 1 - ppu->v.scroll.ny;
+    } else if (y == 31) {
+      y = 0;
+    } else {
+      y++;
     }
+    ppu->v.scroll.y_coarse = y;
   }
-  data |= attr.attr.palette * 0x44444444;
-  return data;
+}
+
+static void ppu_cycle_copy_hori(ppu_t* ppu) {
+  ppu->v.scroll.x_coarse = ppu->t.scroll.x_coarse;
+  ppu->v.scroll.nx = ppu->t.scroll.nx;
+}
+
+// Inlined into both renderers, the per-dot one slows down otherwise
+__attribute__((always_inline)) static inline void ppu_render_pixel(
+    ppu_t* ppu, uint16_t cycle, uint8_t pixel_bg) {
+  bool show_sprites = ppu->mask_show_sprites;
+  bool show_bg = ppu->mask_show_bg;
+  uint8_t pixel = 0;
+  if ((ppu->v.raw & 0x3F00) == 0x3F00 &&
+      !(ppu->mask_show_bg || ppu->mask_show_sprites)) {
+    pixel = ppu->v.raw;
+  }
+
+  bool edge = (cycle < 8 || (cycle >= 249 && cycle <= 256));
+  bool edge_masked =
+      edge || (!ppu->mask_show_left_bg || !ppu->mask_show_left_sprites);
+  bool show_bg_e = show_bg && (!edge || ppu->mask_show_left_bg);
+  bool show_sprites_e = show_sprites && (!edge || ppu->mask_show_left_sprites);
+
+  // Render background
+  if (show_bg_e) {
+    if (pixel_bg & 3) {
+      // Show the pixel if it is non-transparent
+      pixel = pixel_bg;
+    }
+  }
+
+  // PROFILER_POINT(sys->profiler, SYS_PPU_BG)
+
+  // Render sprites
+  if (show_sprites_e) {
+    uint8_t pixel_sprite = ppu->spr_line[cycle - 1];
+    if (pixel_sprite & 3) {
+      // Register sprite-0 hit if applicable
+      if (pixel && (pixel_sprite & PPU_SPR_SPRITE0) && !edge_masked &&
+          cycle != 255) {
+        ppu->status_sprite0_hit = true;
+      }
+      // Render the pixel unless behind-background placement wanted
+      if (!(pixel_sprite & PPU_SPR_PRIORITY) || !pixel) {
+        pixel = (pixel_sprite & 0x0F) + 0x10;
+      }
+    }
+  }
+
+  // PROFILER_POINT(sys->profiler, SYS_PPU_SPRITES)
+
+  if (!ppu->render) {
+    return;
+  }
+
+  // Use the current driver to render the pixel
+  ppu_frame_t* frame = ppu->frame_buffers + ppu->frame_back;
+  switch (ppu->driver) {
+    case PPUD_DIRECT:
+      // Apply the palette, colours are only converted when presented
+      frame->screen[cycle - 1 + ppu->scanline * 256] =
+          ppu->palette_cache[pixel];
+      frame->emphasis[ppu->scanline] = ppu->mask_emphasis;
+      break;
+    case PPUD_SIGNAL:
+      // TODO: NTSC signal
+      break;
+  }
+}
+
+static void ppu_render_backdrop(ppu_t* ppu, uint16_t cycle, uint16_t count) {
+  if (!ppu->render || ppu->driver != PPUD_DIRECT) {
+    return;
+  }
+  // Every frame buffer is drawn in full, otherwise the lines left out would
+  // show whatever was drawn there frames ago
+  uint8_t pixel = 0;
+  if ((ppu->v.raw & 0x3F00) == 0x3F00) {
+    // The palette entry at v is shown instead while v points there
+    pixel = ppu->v.raw & 0x1F;
+  }
+  ppu_frame_t* frame = ppu->frame_buffers + ppu->frame_back;
+  memset(frame->screen + cycle - 1 + ppu->scanline * 256,
+         ppu->palette_cache[pixel], count);
+  frame->emphasis[ppu->scanline] = ppu->mask_emphasis;
+}
+
+static void ppu_frame_publish(ppu_t* ppu) {
+  ppu->frame_buffers[ppu->frame_back].number = ++ppu->frame_number;
+  // Release the frame, and take the one it replaces unless it was acquired
+  uint8_t ready = __atomic_exchange_n(
+      &ppu->frame_ready, ppu->frame_back | PPU_FRAME_FRESH, __ATOMIC_ACQ_REL);
+  ppu->frame_back = ready & ~PPU_FRAME_FRESH;
+}
+
+/**
+ * Span compositor
+ *
+ * The scanline renderer composites the background and the sprites 8 pixels at
+ * a time, with SSE2 or NEON where available. Building with NO_SIMD selects the
+ * scalar version, which gives the same results. Sprite pixels are stored as
+ * in the format of the sprite line buffer.
+ *
+ * ppu_span_composite
+ *   Merges background and sprite pixels of a span into palette indices.
+ *   Returns whether sprite 0 hit.
+ */
+#define PPU_SPAN 8
+
+#if defined(__SSE2__) && !defined(NO_SIMD)
+static bool ppu_span_composite(const uint8_t* bg, const uint8_t* spr,
+                               uint8_t* pixels) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i color = _mm_set1_epi8(3);
+  __m128i b = _mm_loadl_epi64((const __m128i*)bg);
+  __m128i s = _mm_loadl_epi64((const __m128i*)spr);
+  __m128i bg_clear = _mm_cmpeq_epi8(_mm_and_si128(b, color), zero);
+  __m128i spr_clear = _mm_cmpeq_epi8(_mm_and_si128(s, color), zero);
+
+  __m128i sprite0 = _mm_set1_epi8(PPU_SPR_SPRITE0);
+  __m128i hit = _mm_andnot_si128(_mm_or_si128(bg_clear, spr_clear),
+                                 _mm_cmpeq_epi8(_mm_and_si128(s, sprite0),
+                                                sprite0));
+
+  __m128i priority = _mm_set1_epi8(PPU_SPR_PRIORITY);
+  __m128i behind = _mm_andnot_si128(
+      bg_clear, _mm_cmpeq_epi8(_mm_and_si128(s, priority), priority));
+  __m128i use_bg = _mm_or_si128(spr_clear, behind);
+  __m128i bg_pixel = _mm_andnot_si128(bg_clear, b);
+  __m128i spr_pixel = _mm_or_si128(_mm_and_si128(s, _mm_set1_epi8(0x0F)),
+                                   _mm_set1_epi8(0x10));
+  __m128i out = _mm_or_si128(_mm_and_si128(use_bg, bg_pixel),
+                             _mm_andnot_si128(use_bg, spr_pixel));
+  _mm_storel_epi64((__m128i*)pixels, out);
+  return (_mm_movemask_epi8(hit) & 0xFF) != 0;
+}
+#elif defined(__ARM_NEON) && !defined(NO_SIMD)
+static bool ppu_span_composite(const uint8_t* bg, const uint8_t* spr,
+                               uint8_t* pixels) {
+  uint8x8_t b = vld1_u8(bg);
+  uint8x8_t s = vld1_u8(spr);
+  uint8x8_t bg_opaque = vtst_u8(b, vdup_n_u8(3));
+  uint8x8_t spr_opaque = vtst_u8(s, vdup_n_u8(3));
+
+  uint8x8_t hit = vand_u8(vand_u8(bg_opaque, spr_opaque),
+                          vtst_u8(s, vdup_n_u8(PPU_SPR_SPRITE0)));
+
+  uint8x8_t behind = vand_u8(vtst_u8(s, vdup_n_u8(PPU_SPR_PRIORITY)),
+                             bg_opaque);
+  uint8x8_t use_spr = vbic_u8(spr_opaque, behind);
+  uint8x8_t bg_pixel = vand_u8(b, bg_opaque);
+  uint8x8_t spr_pixel =
+      vorr_u8(vand_u8(s, vdup_n_u8(0x0F)), vdup_n_u8(0x10));
+  vst1_u8(pixels, vbsl_u8(use_spr, spr_pixel, bg_pixel));
+  return vget_lane_u64(vreinterpret_u64_u8(hit), 0) != 0;
+}
+#else
+static bool ppu_span_composite(const uint8_t* bg, const uint8_t* spr,
+                               uint8_t* pixels) {
+  bool hit = false;
+  for (uint8_t i = 0; i < PPU_SPAN; i++) {
+    bool bg_opaque = bg[i] & 3;
+    bool spr_opaque = spr[i] & 3;
+    if (bg_opaque && spr_opaque && (spr[i] & PPU_SPR_SPRITE0)) {
+      hit = true;
+    }
+    if (spr_opaque && !(bg_opaque && (spr[i] & PPU_SPR_PRIORITY))) {
+      pixels[i] = (spr[i] & 0x0F) + 0x10;
+    } else {
+      pixels[i] = bg_opaque ? bg[i] : 0;
+    }
+  }
+  return hit;
+}
+#endif
+
+/**
+ * Scanline renderer
+ *
+ * The CPU only accesses the PPU registers, and writes the mapper registers,
+ * after synchronising the PPU (see sys.c). A span of cycles given to ppu_run
+ * therefore never contains a register write, bank switch or sprite-0 query:
+ * those land between calls. Whenever ppu_run starts a scanline and has to run
+ * all of it, the line is drawn tile by tile instead of dot by dot, with the
+ * same results as ppu_cycle. The lines where VBlank starts or ends always run
+ * per dot.
+ *
+ * ppu_scanline_fetch
+ *   Background fetches for a tile, as done over 8 dots.
+ *
+ * ppu_scanline_eval
+ *   Sprite evaluation for the next scanline, as done over dots 63-256, but
+ *   only visiting the OAM entries in range.
+ *
+ * ppu_scanline_render
+ *   Runs a visible scanline with rendering enabled.
+ *
+ * ppu_scanline
+ *   Runs a whole scanline from dot 0. Returns false if the scanline has to
+ *   run per dot.
+ */
+static void ppu_scanline_fetch(ppu_t* ppu) {
+  ppu_cycle_addr_nt(ppu);
+  ppu_cycle_fetch_nt(ppu, false);
+  ppu_cycle_addr_at(ppu);
+  ppu_cycle_fetch_at(ppu, false);
+  ppu_cycle_bg_low(ppu);
+  ppu_cycle_bg_high(ppu);
+  ppu->tile_data <<= 32;
+  ppu_cycle_tile(ppu);
+  ppu_cycle_inc_hori(ppu);
+}
+
+static void ppu_scanline_eval(ppu_t* ppu) {
+  // OAM clear
+  ppu->spr_count_max += ppu->spr_count_next;
+  ppu->spr_count_next = 0;
+  uint64_t sprites = ppu->oam_lines[ppu->scanline];
+  if (sprites & 1) {
+    // Dots 64 and 67 both evaluate sprite 0
+    ppu_cycle_eval(ppu, 0);
+  }
+  for (; sprites != 0; sprites &= sprites - 1) {
+    ppu_cycle_eval(ppu, __builtin_ctzll(sprites));
+  }
+}
+
+static void ppu_scanline_render(ppu_t* ppu) {
+  // Sprite 0 hits are never registered if either left column is hidden
+  uint8_t spr_mask = ppu->mask_show_left_bg && ppu->mask_show_left_sprites
+                         ? 0xFF
+                         : ~PPU_SPR_SPRITE0;
+  // Without rendering, only lines with sprite 0 need compositing
+  bool composite = ppu->render || ppu->spr_line_zero;
+
+  // Dots 1-256: pixels, and the tiles for the 8 dots after
+  for (uint16_t cycle = 1; cycle <= 256; cycle += PPU_SPAN) {
+    if (!composite) {
+      ppu_scanline_fetch(ppu);
+      continue;
+    }
+    uint8_t bg[PPU_SPAN] = {0};
+    uint8_t spr[PPU_SPAN] = {0};
+    uint8_t pixels[PPU_SPAN];
+
+    if (ppu->mask_show_bg) {
+      uint32_t tile = ppu->tile_data >> (32 - ppu->x * 4);
+      for (uint8_t i = 0; i < PPU_SPAN; i++) {
+        bg[i] = (tile >> (28 - i * 4)) & 0x0F;
+      }
+    }
+    if (ppu->mask_show_sprites) {
+      for (uint8_t i = 0; i < PPU_SPAN; i++) {
+        spr[i] = ppu->spr_line[cycle - 1 + i] & spr_mask;
+      }
+    }
+    if (cycle < 8 || cycle >= 249) {
+      // Edge dots, see ppu_render_pixel
+      for (uint8_t i = 0; i < PPU_SPAN; i++) {
+        uint16_t dot = cycle + i;
+        if (dot < 8 || dot >= 249) {
+          bg[i] &= ppu->mask_show_left_bg ? 0xFF : 0;
+          spr[i] &= ppu->mask_show_left_sprites ? 0xFF : 0;
+          spr[i] &= ~PPU_SPR_SPRITE0;
+        } else if (dot == 255) {
+          spr[i] &= ~PPU_SPR_SPRITE0;
+        }
+      }
+    }
+
+    if (ppu_span_composite(bg, spr, pixels)) {
+      ppu->status_sprite0_hit = true;
+    }
+    if (ppu->render && ppu->driver == PPUD_DIRECT) {
+      ppu_frame_t* frame = ppu->frame_buffers + ppu->frame_back;
+      uint8_t* screen = frame->screen + cycle - 1 + ppu->scanline * 256;
+      for (uint8_t i = 0; i < PPU_SPAN; i++) {
+        screen[i] = ppu->palette_cache[pixels[i]];
+      }
+      frame->emphasis[ppu->scanline] = ppu->mask_emphasis;
+    }
+    ppu_scanline_fetch(ppu);
+  }
+  ppu_cycle_inc_vert(ppu);
+  ppu_scanline_eval(ppu);
+
+  // Dots 257-320: sprite fetches, with garbage nametable fetches
+  ppu_cycle_sprite_clear(ppu);
+  for (uint8_t i = 0; i < 8; i++) {
+    ppu_cycle_addr_nt(ppu);
+    if (i == 0) {
+      ppu_cycle_copy_hori(ppu);
+    }
+    ppu_cycle_addr_at(ppu);
+    ppu_cycle_fetch_at(ppu, true);
+    ppu_cycle_sprite(ppu);
+  }
+
+  // Dots 321-336: first two tiles of the next scanline
+  ppu_scanline_fetch(ppu);
+  ppu_scanline_fetch(ppu);
+
+  // Dots 337-340: garbage nametable fetches
+  ppu_cycle_addr_nt(ppu);
+  ppu_cycle_addr_at(ppu);
+  ppu_cycle_fetch_at(ppu, true);
+}
+
+static bool ppu_scanline(ppu_t* ppu) {
+  if (ppu->scanline == PPU_SL_VBLANK || ppu->scanline == PPU_SL_PRERENDER) {
+    return false;
+  }
+  if (ppu->scanline < PPU_SL_POSTRENDER) {
+    if (ppu->mask_show_bg || ppu->mask_show_sprites) {
+      ppu_scanline_render(ppu);
+    } else {
+      ppu_render_backdrop(ppu, 1, PPU_SCREEN_WIDTH);
+    }
+  }
+  if (ppu->scanline == 0) {
+    ppu->spr_count_max = 0;
+  }
+  ppu->oam_data_ff = false;
+  ppu->nmi = ppu->nmi_occurred && ppu->nmi_output;
+  ppu->cycle = 0;
+  ppu->scanline++;
+  if (ppu->scanline == PPU_SL_POSTRENDER && ppu->render) {
+    ppu_frame_publish(ppu);
+  }
+  return true;
 }
 
 /**
@@ -178,6 +628,7 @@ void ppu_mem_write(ppu_t* ppu, uint16_t address, uint8_t value) {
     if (ppu->oam_address) {
       memcpy(ppu->oam.raw, buf + (256 - ppu->oam_address), ppu->oam_address);
     }
+    ppu_oam_index(ppu);
     return;
   }
 
@@ -186,7 +637,8 @@ void ppu_mem_write(ppu_t* ppu, uint16_t address, uint8_t value) {
   address &= 0x7;
 
   switch (address) {
-    case PPU_ADDR_PPUCTRL:  // 0
+    case PPU_ADDR_PPUCTRL: {  // 0
+      uint8_t sprite_size = ppu->sprite_size;
       // Destructure register
       ppu->reg_ctrl.raw = value;
       ppu->ctrl_nametable = ppu->reg_ctrl.flags.nametable;
@@ -201,7 +653,10 @@ void ppu_mem_write(ppu_t* ppu, uint16_t address, uint8_t value) {
       ppu->increment = (ppu->ctrl_increment ? 32 : 1);
       ppu->t.nt_select.nt = ppu->ctrl_nametable;
       ppu->nmi_output = ppu->ctrl_nmi;
-      break;
+      if (ppu->sprite_size != sprite_size) {
+        ppu_oam_index(ppu);
+      }
+    } break;
     case PPU_ADDR_PPUMASK:  // 1
       // Destructure register
       ppu->reg_mask.raw = value;
@@ -210,12 +665,20 @@ void ppu_mem_write(ppu_t* ppu, uint16_t address, uint8_t value) {
       ppu->mask_show_left_sprites = ppu->reg_mask.flags.show_left_sprites;
       ppu->mask_show_bg = ppu->reg_mask.flags.show_bg;
       ppu->mask_show_sprites = ppu->reg_mask.flags.show_sprites;
+      ppu->mask_emphasis = ppu->reg_mask.flags.emphasis;
       break;
     case PPU_ADDR_OAMADDR:  // 3
       ppu->oam_address = value;
       break;
     case PPU_ADDR_OAMDATA:  // 4
-      ppu->oam.raw[ppu->oam_address] = value;
+      if (ppu->oam_address % 4 == 0) {
+        // Moves the sprite to other scanlines
+        ppu_oam_index_sprite(ppu, ppu->oam_address / 4, false);
+        ppu->oam.raw[ppu->oam_address] = value;
+        ppu_oam_index_sprite(ppu, ppu->oam_address / 4, true);
+      } else {
+        ppu->oam.raw[ppu->oam_address] = value;
+      }
       ppu->oam_address++;
       break;
     case PPU_ADDR_PPUSCROLL:  // 5
@@ -246,8 +709,7 @@ void ppu_mem_write(ppu_t* ppu, uint16_t address, uint8_t value) {
         }
         ppu_addr &= 0x1F;
         ppu->palette[ppu_addr] = value & 0x3F;
-        ppu->palette_cache[ppu_addr] =
-            ppu->nes_palette_direct[value & ppu->mask_gray];
+        ppu->palette_cache[ppu_addr] = value & ppu->mask_gray;
       } else {
         mmap_ppu_write(ppu->mapper, ppu_addr, value);
       }
@@ -334,6 +796,7 @@ void ppu_reset(ppu_t* ppu) {
   for (uint16_t i = 0; i < 256; i++) {
     ppu->oam.raw[i] = 0xFF;
   }
+  ppu_oam_index(ppu);
 }
 
 void ppu_power(ppu_t* ppu) {
@@ -350,7 +813,11 @@ void ppu_power(ppu_t* ppu) {
 ppu_t* ppu_init(void) {
   ppu_t* ppu = calloc(1, sizeof(ppu_t));
   ppu->driver = PPUD_DIRECT;
+  ppu->render = true;
   ppu->flip = false;
+  ppu->frame_back = 0;
+  ppu->frame_ready = 1;
+  ppu->frame_front = 2;
   ppu_power(ppu);
   return ppu;
 }
@@ -370,80 +837,12 @@ void ppu_cycle(ppu_t* ppu) {
 
   // Most PPU operations are done only when rendering is enabled
   if (rendering) {
-    if (line_visible && cycle_visible) {
+    if (line_visible && cycle_visible &&
+        (ppu->render || ppu->spr_line_zero)) {
       // Render a pixel
-      uint8_t pixel = 0;
-      if ((ppu->v.raw & 0x3F00) == 0x3F00 &&
-          !(ppu->mask_show_bg || ppu->mask_show_sprites)) {
-        pixel = ppu->v.raw;
-      }
-
-      bool edge = (ppu->cycle < 8 || (ppu->cycle >= 249 && ppu->cycle <= 256));
-      bool edge_masked =
-          edge || (!ppu->mask_show_left_bg || !ppu->mask_show_left_sprites);
-      bool show_bg_e = show_bg && (!edge || ppu->mask_show_left_bg);
-      bool show_sprites_e =
-          show_sprites && (!edge || ppu->mask_show_left_sprites);
-
-      // Render background
-      if (show_bg_e) {
-        uint8_t pixel_bg =
-            ((uint32_t)(ppu->tile_data >> 32) >> ((7 - ppu->x) * 4)) & 0x0F;
-        if (pixel_bg & 3) {
-          // Show the pixel if it is non-transparent
-          pixel = pixel_bg;
-        }
-      }
-
-      // PROFILER_POINT(SYS_PPU_BG)
-
-      // Render sprites
-      if (show_sprites_e) {
-        uint8_t pixel_sprite = 0;
-        uint8_t spr_found = 0xFF;
-        for (uint8_t i = 0; i < ppu->spr_count; i++) {
-          int16_t offset = (ppu->cycle - 1) - ppu->spr_pos[i];
-          if (offset < 0 || offset > 7) {
-            continue;
-          }
-          offset = 7 - offset;
-          pixel_sprite = (ppu->spr_pat[i] >> (offset * 4)) & 0x0F;
-          if (pixel_sprite & 3) {
-            // Non-transparent pixel, stop processing sprites
-            spr_found = i;
-            break;
-          }
-        }
-        if (spr_found != 0xFF) {
-          // Register sprite-0 hit if applicable
-          if (cycle_visible && pixel && ppu->spr_index[spr_found] == 0 &&
-              !edge_masked && ppu->cycle != 255 && (pixel_sprite & 3)) {
-            ppu->status_sprite0_hit = true;
-          }
-          // Render the pixel unless behind-background placement wanted
-          if (!ppu->spr_priority[spr_found] || !pixel) {
-            pixel = pixel_sprite + 0x10;
-          }
-        }
-      }
-
-      // PROFILER_POINT(SYS_PPU_SPRITES)
-
-      // Use the current driver to render the pixel
-      switch (ppu->driver) {
-        case PPUD_DIRECT:
-          // Apply the palette
-          // pixel = ppu->palette[pixel] & ppu->mask_gray;
-          // ppu->screen_dbg[ppu->cycle - 1 + ppu->scanline * 256] =
-          // ppu->palette[pixel] & ppu->mask_gray;
-          ppu->screen[ppu->cycle - 1 + ppu->scanline * 256] =
-              ppu->palette_cache[pixel];
-          // Emphasis | (reg.EmpRGB << 6);
-          break;
-        case PPUD_SIGNAL:
-          // TODO: NTSC signal
-          break;
-      }
+      uint8_t pixel_bg =
+          ((uint32_t)(ppu->tile_data >> 32) >> ((7 - ppu->x) * 4)) & 0x0F;
+      ppu_render_pixel(ppu, ppu->cycle, pixel_bg);
     }
 
     if (line_render && cycle_fetch) {
@@ -477,31 +876,12 @@ void ppu_cycle(ppu_t* ppu) {
       } else if (line_visible && ppu->cycle >= 64 && ppu->cycle <= 256 &&
                  ppu->cycle % 3 == 1) {
         // Sprite evaluation
-        uint8_t i = (ppu->cycle - 65) / 3;
-        if (ppu->spr_count_next < 9) {
-          uint8_t y = ppu->oam.sprites[i].y;
-          if (ppu->scanline >= y) {
-            uint16_t row = ppu->scanline - y;
-            if (row < ppu->sprite_size) {
-              if (ppu->spr_count_next < 8) {
-                oam_attr_t attr = {.raw = ppu->oam.sprites[i].attr};
-                ppu->spr_row_next[ppu->spr_count_next] = row;
-                ppu->spr_pos_next[ppu->spr_count_next] = ppu->oam.sprites[i].x;
-                ppu->spr_priority_next[ppu->spr_count_next] =
-                    attr.attr.priority;
-                ppu->spr_index_next[ppu->spr_count_next] = i;
-                ppu->spr_count_next++;
-              } else {
-                ppu->status_overflow = true;
-              }
-            }
-          }
-        }
+        ppu_cycle_eval(ppu, (ppu->cycle - 65) / 3);
       }
     } else if (line_render && !cycle_fetch) {
       // Sprite fetches
       if (ppu->cycle == 257) {
-        ppu->spr_count = 0;
+        ppu_cycle_sprite_clear(ppu);
       }
       switch (ppu->cycle % 8) {
         case 1:
@@ -517,17 +897,7 @@ void ppu_cycle(ppu_t* ppu) {
           ppu_cycle_fetch_at(ppu, true);  // Garbage
           break;
         case 5:
-          if (ppu->spr_count < 8 && ppu->spr_count < ppu->spr_count_next) {
-            ppu->spr_pat[ppu->spr_count] =
-                ppu_fetch_sprite(ppu, ppu->spr_index_next[ppu->spr_count],
-                                 ppu->spr_row_next[ppu->spr_count]);
-            ppu->spr_pos[ppu->spr_count] = ppu->spr_pos_next[ppu->spr_count];
-            ppu->spr_priority[ppu->spr_count] =
-                ppu->spr_priority_next[ppu->spr_count];
-            ppu->spr_index[ppu->spr_count] =
-                ppu->spr_index_next[ppu->spr_count];
-            ppu->spr_count++;
-          }
+          ppu_cycle_sprite(ppu);
           break;
       }
     }
@@ -541,40 +911,19 @@ void ppu_cycle(ppu_t* ppu) {
 
     if (line_render) {
       if (cycle_fetch && ppu->cycle % 8 == 0) {
-        // Increment hori(v)
-        if (ppu->v.scroll.x_coarse < 31) {
-          ppu->v.scroll.x_coarse++;
-        } else {
-          ppu->v.scroll.x_coarse = 0;
-          ppu->v.scroll.nx = 1 - ppu->v.scroll.nx;
-        }
+        ppu_cycle_inc_hori(ppu);
       }
 
       if (ppu->cycle == 256) {
-        // Increment vert(v)
-        if (ppu->v.scroll.y_fine < 7) {
-          ppu->v.scroll.y_fine++;
-        } else {
-          ppu->v.scroll.y_fine = 0;
-          uint8_t y = ppu->v.scroll.y_coarse;
-          if (y == 29) {
-            y = 0;
-            ppu->v.scroll.ny = 1 - ppu->v.scroll.ny;
-          } else if (y == 31) {
-            y = 0;
-          } else {
-            y++;
-          }
-          ppu->v.scroll.y_coarse = y;
-        }
+        ppu_cycle_inc_vert(ppu);
       }
 
       if (ppu->cycle == 257) {
-        // hori(v) = hori(t)
-        ppu->v.scroll.x_coarse = ppu->t.scroll.x_coarse;
-        ppu->v.scroll.nx = ppu->t.scroll.nx;
+        ppu_cycle_copy_hori(ppu);
       }
     }
+  } else if (line_visible && cycle_visible) {
+    ppu_render_backdrop(ppu, ppu->cycle, 1);
   }
 
   if (ppu->scanline == 0) {
@@ -582,8 +931,9 @@ void ppu_cycle(ppu_t* ppu) {
   }
 
   // NMI and flag operations
-  if (ppu->scanline == 241 && ppu->cycle == 1) {
+  if (ppu->scanline == PPU_SL_VBLANK && ppu->cycle == 1) {
     // Start VBlank
+    ppu->frames++;
     ppu->nmi_occurred = true;
     ppu->status_sprite0_hit = false;
   } else if (ppu->scanline == 261 && ppu->cycle == 1) {
@@ -603,6 +953,9 @@ void ppu_cycle(ppu_t* ppu) {
   if (ppu->cycle >= sl_cycles) {
     ppu->cycle = 0;
     ppu->scanline++;
+    if (ppu->scanline == PPU_SL_POSTRENDER && ppu->render) {
+      ppu_frame_publish(ppu);
+    }
     if (ppu->scanline >= PPU_SCANLINES) {
       ppu->flip = true;
       ppu->scanline = PPU_SL_VISIBLE;
@@ -610,7 +963,59 @@ void ppu_cycle(ppu_t* ppu) {
     }
   }
 
-  // PROFILER_POINT(SYS_PPU_LOGIC)
+  // PROFILER_POINT(sys->profiler, SYS_PPU_LOGIC)
+}
+
+void ppu_run(ppu_t* ppu, uint32_t cycles) {
+  while (cycles > 0) {
+    if (ppu->cycle == 0 && cycles >= PPU_CYCLES && ppu_scanline(ppu)) {
+      cycles -= PPU_CYCLES;
+    } else {
+      ppu_cycle(ppu);
+      cycles--;
+    }
+  }
+}
+
+/**
+ * Returns the number of cycles until the given dot is executed, counting the
+ * dot itself. When wrapping around, the frame is assumed to skip its last dot,
+ * which may make the result one cycle early, but never late.
+ */
+static uint32_t ppu_cycles_until(ppu_t* ppu, uint16_t scanline,
+                                 uint16_t cycle) {
+  int32_t cycles = ((int32_t)scanline - ppu->scanline) * PPU_CYCLES +
+                   ((int32_t)cycle - ppu->cycle);
+  if (cycles < 0) {
+    cycles += PPU_SCANLINES * PPU_CYCLES - 1;
+  }
+  return cycles + 1;
+}
+
+uint32_t ppu_nmi_deadline(ppu_t* ppu) {
+  if (ppu->nmi != (ppu->nmi_occurred && ppu->nmi_output)) {
+    // A register access changed the output, updated in the next cycle
+    return 1;
+  }
+
+  // Start and end of VBlank
+  uint32_t start = ppu_vblank_deadline(ppu);
+  uint32_t end = ppu_cycles_until(ppu, PPU_SL_PRERENDER, 1);
+  return start < end ? start : end;
+}
+
+uint32_t ppu_vblank_deadline(ppu_t* ppu) {
+  return ppu_cycles_until(ppu, PPU_SL_VBLANK, 1);
+}
+
+const ppu_frame_t* ppu_frame_acquire(ppu_t* ppu) {
+  if (__atomic_load_n(&ppu->frame_ready, __ATOMIC_RELAXED) & PPU_FRAME_FRESH) {
+    // Take the newest frame, and give back the one last acquired
+    uint8_t ready = __atomic_exchange_n(&ppu->frame_ready, ppu->frame_front,
+                                        __ATOMIC_ACQ_REL);
+    ppu->frame_front = ready & ~PPU_FRAME_FRESH;
+  }
+  return ppu->frame_buffers + ppu->frame_front;
 }
 
 void ppu_deinit(ppu_t* ppu) { free(ppu); }
@@ -23,8 +23,13 @@
  * SOFTWARE.
  */
 
-#include <SDL.h>
 #include <stdint.h>
+#include <stdlib.h>
+#ifdef HEADLESS
+#include <time.h>
+#else
+#include <SDL.h>
+#endif
 
 #include "profiler.h"
 
@@ -32,39 +37,42 @@
  * profiler.c
  */
 
-#ifdef PROFILER
-static uint8_t samples = 0;
-static uint32_t ticks[PROFILER_NUM_POINTS] = {0};
-static float times[PROFILER_NUM_POINTS] = {0.0};
-static int last_tick = 0;
+#ifdef HEADLESS
+#define PROFILER_TICKS() ((int)(clock() * 1000 / CLOCKS_PER_SEC))
+#else
+#define PROFILER_TICKS() SDL_GetTicks()
+#endif
+
+profiler_t* profiler_init(void) { return calloc(1, sizeof(profiler_t)); }
+
+void profiler_deinit(profiler_t* profiler) { free(profiler); }
 
-void profiler_set_point(profiler_point_t p) {
-  int next_tick = SDL_GetTicks();
+#ifdef PROFILER
+void profiler_set_point(profiler_t* profiler, profiler_point_t p) {
+  int next_tick = PROFILER_TICKS();
   if (p == PROF_START) {
-    last_tick = next_tick;
+    profiler->last_tick = next_tick;
     return;
   }
-  ticks[p - 1] += next_tick - last_tick;
-  last_tick = next_tick;
+  profiler->ticks[p - 1] += next_tick - profiler->last_tick;
+  profiler->last_tick = next_tick;
 }
 
-float* profiler_get_times() {
-  samples++;
-  if (samples >= 40) {
+float* profiler_get_times(profiler_t* profiler) {
+  profiler->samples++;
+  if (profiler->samples >= 40) {
     uint32_t total_ticks = 0;
     for (int i = 0; i < PROFILER_NUM_POINTS; i++) {
-      total_ticks += ticks[i];
+      total_ticks += profiler->ticks[i];
     }
     for (int i = 0; i < PROFILER_NUM_POINTS; i++) {
-      times[i] = ((float)ticks[i] / (float)total_ticks);
-      ticks[i] = 0;
+      profiler->times[i] = ((float)profiler->ticks[i] / (float)total_ticks);
+      profiler->ticks[i] = 0;
     }
-    samples = 0;
+    profiler->samples = 0;
   }
-  return times;
+  return profiler->times;
 }
 #else
-static float times[1] = {0};
-
-float* profiler_get_times() { return times; }
+float* profiler_get_times(profiler_t* profiler) { return profiler->times; }
 #endif
@@ -45,3 +45,34 @@ uint32_t region_screen_height(region region) {
   // FIXME: Control reaches end of non-void function
   return 0;
 }
+
+// https://wiki.nesdev.com/w/index.php/Cycle_reference_chart
+region_timing_t region_timing(region region) {
+  switch (region) {
+    case R_PAL:
+      // 26.6017125 MHz
+      return (region_timing_t){.master_hz_numerator = 53203425,
+                               .master_hz_denominator = 2,
+                               .cpu_divider = 16,
+                               .ppu_divider = 5,
+                               .apu_divider = 16};
+    case R_DENDY:
+      // 26.6017125 MHz
+      return (region_timing_t){.master_hz_numerator = 53203425,
+                               .master_hz_denominator = 2,
+                               .cpu_divider = 15,
+                               .ppu_divider = 5,
+                               .apu_divider = 15};
+    case R_NTSC:
+    case R_RGB3:
+    case R_RGB4:
+    case R_RGB5:
+      break;
+  }
+  // 21.477272 MHz
+  return (region_timing_t){.master_hz_numerator = 236250000,
+                           .master_hz_denominator = 11,
+                           .cpu_divider = 12,
+                           .ppu_divider = 4,
+                           .apu_divider = 12};
+}
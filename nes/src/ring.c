@@ -0,0 +1,120 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017
+ * Aurel Bily, Alexis I. Marinoiu, Andrei V. Serbanescu, Niklas Vangerow
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+/**
+ * ring.c
+ */
+
+/**
+ * Helper functions
+ *
+ * ring_copy_in
+ *   Copies items to the ring, from the given position on, wrapping around.
+ *
+ * ring_copy_out
+ *   Copies items from the ring, from the given position on, wrapping around.
+ */
+static void ring_copy_in(ring_t* ring, uint32_t position, const uint8_t* items,
+                         uint32_t count) {
+  uint32_t start = position & (ring->capacity - 1);
+  uint32_t first = ring->capacity - start < count ? ring->capacity - start
+                                                  : count;
+  memcpy(ring->items + start * ring->item_size, items,
+         first * ring->item_size);
+  memcpy(ring->items, items + first * ring->item_size,
+         (count - first) * ring->item_size);
+}
+
+static void ring_copy_out(ring_t* ring, uint32_t position, uint8_t* items,
+                          uint32_t count) {
+  uint32_t start = position & (ring->capacity - 1);
+  uint32_t first = ring->capacity - start < count ? ring->capacity - start
+                                                  : count;
+  memcpy(items, ring->items + start * ring->item_size,
+         first * ring->item_size);
+  memcpy(items + first * ring->item_size, ring->items,
+         (count - first) * ring->item_size);
+}
+
+/**
+ * Public functions
+ *
+ * See ring.h for descriptions.
+ */
+ring_t* ring_init(uint32_t capacity, uint32_t item_size) {
+  ring_t* ring = malloc(sizeof(ring_t));
+  ring->capacity = 1;
+  while (ring->capacity < capacity) {
+    ring->capacity <<= 1;
+  }
+  ring->item_size = item_size;
+  ring->items = malloc((size_t)ring->capacity * item_size);
+  ring->head = 0;
+  ring->tail = 0;
+  return ring;
+}
+
+uint32_t ring_push(ring_t* ring, const void* items, uint32_t count) {
+  uint32_t head = ring->head;
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  uint32_t space = ring->capacity - (head - tail);
+  if (count > space) {
+    count = space;
+  }
+  ring_copy_in(ring, head, items, count);
+  __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+  return count;
+}
+
+uint32_t ring_pop(ring_t* ring, void* items, uint32_t count) {
+  uint32_t tail = ring->tail;
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  if (count > head - tail) {
+    count = head - tail;
+  }
+  ring_copy_out(ring, tail, items, count);
+  __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+  return count;
+}
+
+uint32_t ring_size(ring_t* ring) {
+  // The tail never passes the head, so loading it first keeps the difference
+  // from going negative. Both may have moved in between, so it can exceed the
+  // capacity though.
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint32_t size = head - tail;
+  return size > ring->capacity ? ring->capacity : size;
+}
+
+void ring_deinit(ring_t* ring) {
+  free(ring->items);
+  free(ring);
+}
@@ -97,6 +97,23 @@ int fread_all(FILE* fp, uint8_t* buf, size_t size) {
   return 0;
 }
 
+// Decodes a pattern table tile, see chr_tile_t
+static void rom_chr_decode(chr_tile_t* tile, const uint8_t* data) {
+  for (uint8_t byte = 0; byte < CHR_TILE_SIZE; byte++) {
+    uint32_t pixels = 0;
+    uint32_t pixels_flipped = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+      pixels <<= 4;
+      pixels |= ((data[byte] << i) & 0x80) >> 7;
+      pixels_flipped <<= 4;
+      pixels_flipped |= (data[byte] >> i) & 1;
+    }
+    tile->planes[byte][0] = pixels;
+    tile->planes[byte][1] = pixels_flipped;
+  }
+  tile->dirty = false;
+}
+
 rom_error_t rom_load(mapper_t** mapper_ptr, const char* path) {
   FILE* fp;
   if (!(fp = fopen(path, "r"))) {
@@ -145,6 +162,9 @@ rom_error_t rom_load(mapper_t** mapper_ptr, const char* path) {
 
   ret->header = header;
   ret->type = type;
+  ret->data = NULL;
+  ret->jit_blocks = NULL;
+  ret->sync = NULL;
 
   // Skip the trainer, if present
   if (header->flags6.data.has_trainer) {
@@ -171,10 +191,21 @@ rom_error_t rom_load(mapper_t** mapper_ptr, const char* path) {
       rom_destroy(ret);
       return RE_CHR_READ_ERROR;
     }
+  } else {
+    mem->chr_ram = calloc(CHR_RAM_SIZE, sizeof(uint8_t));
   }
 
   fclose(fp);
 
+  // Decode the CHR memory once, only tiles written to later are decoded again
+  uint8_t* chr = chr_rom_size != 0 ? mem->chr_rom : mem->chr_ram;
+  size_t chr_tiles = (chr_rom_size != 0 ? chr_rom_size : CHR_RAM_SIZE) /
+                     CHR_TILE_SIZE;
+  mem->chr_tiles = malloc(sizeof(chr_tile_t) * chr_tiles);
+  for (size_t i = 0; i < chr_tiles; i++) {
+    rom_chr_decode(mem->chr_tiles + i, chr + i * CHR_TILE_SIZE);
+  }
+
   // Pre-initialise RAM
   for (uint16_t i = 0; i < 0x800; i++) {
     ret->memory->ram[i] = (i & 4) ? 0xFF : 0x00;
@@ -187,8 +218,11 @@ rom_error_t rom_load(mapper_t** mapper_ptr, const char* path) {
   ret->mapped.sram = NULL;
   ret->mapped.prg_rom1 = ret->memory->prg_rom;
   ret->mapped.prg_rom2 = ret->memory->prg_rom + MC_PRG_ROM_SIZE;
-  ret->mapped.ppu_pattable0 = ret->memory->chr_rom;
+  ret->mapped.ppu_pattable0 = chr;
   ret->mapped.ppu_pattable1 = ret->mapped.ppu_pattable0 + MC_PATTABLE_SIZE;
+  ret->mapped.ppu_pattiles0 = mem->chr_tiles;
+  ret->mapped.ppu_pattiles1 =
+      ret->mapped.ppu_pattiles0 + MC_PATTABLE_SIZE / CHR_TILE_SIZE;
   ret->mapped.ppu_nametable0 = ret->memory->vram;
   ret->mapped.ppu_nametable1 = ret->mapped.ppu_nametable0 + MC_NAMETABLE_SIZE;
   // ret->mapped.ppu_palettes = ret->mapped.ppu_nametable1 + MC_NAMETABLE_SIZE;
@@ -199,6 +233,7 @@ rom_error_t rom_load(mapper_t** mapper_ptr, const char* path) {
   }
 
   MAPPERS[mapper_number].mapper_init(MAPPERS + mapper_number, ret);
+  mmap_cpu_remap(ret);
 
   return RE_SUCCESS;
 }
@@ -206,11 +241,19 @@ rom_error_t rom_load(mapper_t** mapper_ptr, const char* path) {
 void rom_destroy(mapper_t* mapper) {
   uint32_t mapper_number = rom_get_mapper_number(mapper);
   MAPPERS[mapper_number].mapper_deinit(MAPPERS + mapper_number, mapper);
+  if (mapper->jit_blocks != NULL) {
+    size_t prg_rom_size = rom_get_prg_rom_size(mapper);
+    for (size_t i = 0; i < prg_rom_size; i++) {
+      free(mapper->jit_blocks[i]);
+    }
+    free(mapper->jit_blocks);
+  }
   free(mapper->header);
   free(mapper->memory->prg_rom);
   free(mapper->memory->prg_ram);
   free(mapper->memory->chr_rom);
   free(mapper->memory->chr_ram);
+  free(mapper->memory->chr_tiles);
   free(mapper->memory);
   free(mapper);
 }
@@ -312,7 +355,23 @@ bool rom_has_bus_conflicts(mapper_t* mapper) {
   if (mapper->mapped.WHAT != NULL)
 
 // Memory access functions
+// Writes that reach the mapper may switch CHR banks under the PPU, so they
+// synchronise as well
+static void mmap_cpu_sync(mapper_t* mapper, uint16_t address, bool write) {
+  if (address >= MC_PPU_CTRL_BASE &&
+      (write || address < MC_REGISTERS_UPPER) && mapper->sync != NULL) {
+    mapper->sync(mapper->sync_context);
+  }
+}
+
 void mmap_cpu_write(mapper_t* mapper, uint16_t address, uint8_t val) {
+  uint8_t* host = mapper->pages[MMAP_PAGE(address)].write;
+  if (host != NULL) {
+    host[MMAP_OFFSET(address)] = val;
+    return;
+  }
+  mmap_cpu_sync(mapper, address, true);
+
   if (address >= MC_WORK_RAM_BASE && address < MC_WORK_RAM_UPPER) {
     MEMACCESS_VALID(ram, (address - MC_WORK_RAM_BASE) % WORK_RAM_SIZE, address,
                     true) {
@@ -346,6 +405,12 @@ void mmap_cpu_write(mapper_t* mapper, uint16_t address, uint8_t val) {
 }
 
 uint8_t mmap_cpu_read(mapper_t* mapper, uint16_t address, bool dummy) {
+  uint8_t* host = mapper->pages[MMAP_PAGE(address)].read;
+  if (host != NULL) {
+    return host[MMAP_OFFSET(address)];
+  }
+  mmap_cpu_sync(mapper, address, false);
+
   if (address >= MC_WORK_RAM_BASE && address < MC_WORK_RAM_UPPER) {
     MEMACCESS_VALID(ram, address - MC_WORK_RAM_BASE, address, false) {
       return mapper->mapped.ram[(address - MC_WORK_RAM_BASE) % WORK_RAM_SIZE];
@@ -404,6 +469,43 @@ uint8_t mmap_cpu_read(mapper_t* mapper, uint16_t address, bool dummy) {
                                          address);
 }
 
+uint8_t* mmap_cpu_host(mapper_t* mapper, uint16_t address) {
+  uint8_t* host = mapper->pages[MMAP_PAGE(address)].read;
+  if (host == NULL) {
+    return NULL;
+  }
+  return host + MMAP_OFFSET(address);
+}
+
+/**
+ * Maps the pages of a region to consecutive host memory, or to the slow path
+ * if host is NULL.
+ */
+static void mmap_cpu_map(mapper_t* mapper, uint16_t base, uint32_t size,
+                         uint8_t* host, bool writable) {
+  for (uint32_t offset = 0; offset < size; offset += MMAP_PAGE_SIZE) {
+    mmap_page_t* page = &mapper->pages[MMAP_PAGE(base + offset)];
+    page->read = host == NULL ? NULL : host + offset;
+    page->write = host == NULL || !writable ? NULL : host + offset;
+  }
+}
+
+void mmap_cpu_remap(mapper_t* mapper) {
+  // Everything not listed below has side effects or is unmapped
+  memset(mapper->pages, 0, sizeof(mapper->pages));
+
+  for (uint8_t i = 0; i < MC_WORK_RAM_OCCURRENCES; i++) {
+    mmap_cpu_map(mapper, MC_WORK_RAM_BASE + i * WORK_RAM_SIZE, WORK_RAM_SIZE,
+                 mapper->mapped.ram, true);
+  }
+  mmap_cpu_map(mapper, MC_SRAM_BASE, SRAM_SIZE, mapper->mapped.sram, true);
+  // Writes to ROM go to the mapper registers
+  mmap_cpu_map(mapper, MC_PRG_ROM1_BASE, MC_PRG_ROM_SIZE,
+               mapper->mapped.prg_rom1, false);
+  mmap_cpu_map(mapper, MC_PRG_ROM2_BASE, MC_PRG_ROM_SIZE,
+               mapper->mapped.prg_rom2, false);
+}
+
 void mmap_cpu_dma(mapper_t* mapper, uint8_t address, uint8_t* buf) {
   uint16_t cur = address * 0x100;
   mapper->cpu->busy += 513;  // TODO: odd cycles + 1
@@ -420,11 +522,17 @@ void mmap_ppu_write(mapper_t* mapper, uint16_t address, uint8_t val) {
 
   if (address >= MC_PATTABLE0_BASE && address <= MC_PATTABLE0_UPPER) {
     mapper->mapped.ppu_pattable0[address - MC_PATTABLE0_BASE] = val;
+    mapper->mapped
+        .ppu_pattiles0[(address - MC_PATTABLE0_BASE) / CHR_TILE_SIZE]
+        .dirty = true;
     return;
   }
 
   if (address >= MC_PATTABLE1_BASE && address < MC_PATTABLE1_UPPER) {
     mapper->mapped.ppu_pattable1[address - MC_PATTABLE1_BASE] = val;
+    mapper->mapped
+        .ppu_pattiles1[(address - MC_PATTABLE1_BASE) / CHR_TILE_SIZE]
+        .dirty = true;
     return;
   }
 
@@ -488,3 +596,18 @@ uint8_t mmap_ppu_read(mapper_t* mapper, uint16_t address) {
   return MAPPERS[mapper_number].ppu_read(MAPPERS + mapper_number, mapper,
                                          address);
 }
+
+uint32_t mmap_ppu_pattern(mapper_t* mapper, uint16_t address, bool flip_h) {
+  uint8_t* table = mapper->mapped.ppu_pattable0;
+  chr_tile_t* tiles = mapper->mapped.ppu_pattiles0;
+  if (address >= MC_PATTABLE1_BASE) {
+    table = mapper->mapped.ppu_pattable1;
+    tiles = mapper->mapped.ppu_pattiles1;
+    address -= MC_PATTABLE1_BASE;
+  }
+  chr_tile_t* tile = tiles + address / CHR_TILE_SIZE;
+  if (tile->dirty) {
+    rom_chr_decode(tile, table + address - address % CHR_TILE_SIZE);
+  }
+  return tile->planes[address % CHR_TILE_SIZE][flip_h];
+}
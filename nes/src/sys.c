@@ -40,71 +40,207 @@
 
 sys_t* sys_init(void) {
   sys_t* sys = malloc(sizeof(sys_t));
-  sys->clock = 0.0;
+  sys->clock = 0;
+  sys->clock_remainder = 0;
+  sys->cycles = 0;
+  sys->ppu_cycles = 0;
+  sys->apu_cycles = 0;
+  sys->deadline = 0;
+  sys->audio_context = NULL;
+  sys->enqueue_audio = NULL;
+  sys->get_queue_size = NULL;
+  sys->region = R_NTSC;
+  sys->timing = region_timing(sys->region);
+  sys->events = event_init();
   sys->cpu = cpu_init();
   sys->ppu = ppu_init();
-  sys->apu = apu_init();
+  sys->apu = apu_init(sys->events, sys->timing.master_hz_numerator,
+                      sys->timing.master_hz_denominator,
+                      sys->timing.apu_divider);
   sys->controller = controller_init();
+  sys->profiler = profiler_init();
   sys->mapper = NULL;
 
-  sys->region = R_NTSC;
   sys->status = SS_NONE;
   sys->running = false;
   for (int i = 0; i < NUM_CONTROLLER_DRIVERS; i++) {
-    (*CONTROLLER_DRIVERS[i].init)();
+    (*CONTROLLER_DRIVERS[i].init)(&sys->controller->drivers[i]);
   }
   return sys;
 }
 
-// TODO: move this to region
-#define CLOCKS_PER_MILLISECOND 21477.272
-#define CLOCK_PERIOD (12.0 / CLOCKS_PER_MILLISECOND)
-
 static void sys_reset(sys_t* sys);
 
-bool sys_run(sys_t* sys, uint32_t ms, void* context,
-             apu_enqueue_audio_t enqueue_audio,
-             apu_get_queue_size_t get_queue_size) {
-  if (sys->running) {
-    PROFILER_POINT(SYS_START)
-
-    sys->clock += ms;
-    while (sys->clock >= CLOCK_PERIOD) {
-      cpu_nmi(sys->cpu, sys->ppu->nmi);
-      if (cpu_cycle(sys->cpu)) {
-        // Trapped, stop execution
-        switch (sys->cpu->status) {
-          case CS_UNSUPPORTED_INSTRUCTION:
-            sys->status = SS_CPU_UNSUPPORTED_INSTRUCTION;
-            break;
-          default:
-            break;
-        }
-        sys->running = false;
+/**
+ * Scheduler
+ *
+ * All devices are clocked by dividing the master clock (see region.h). Within
+ * a master clock cycle, the CPU is clocked before the PPU, which is clocked
+ * before the APU.
+ *
+ * The CPU runs ahead of the PPU and the APU, which are only synchronised with
+ * it (run in bulk up to the current CPU cycle) when the CPU accesses one of
+ * their registers, or when the next event in the queue is due (see event.h).
+ * These include every possible interrupt. Until then, the CPU executes whole
+ * instructions and skips over the cycles it spends busy (see cpu_run). From the deadline of
+ * the next event, the system runs in lockstep for one cycle, exactly like a
+ * per-cycle loop would. The APU schedules its own events, while the PPU is
+ * asked for its NMI deadline after every synchronisation.
+ *
+ * sys_master_time
+ *   Returns the last master clock cycle of the given cycle of a device with
+ *   the given divider.
+ *
+ * sys_cycles_before
+ *   Returns the number of cycles a device with the given divider runs before
+ *   the given CPU cycle.
+ *
+ * sys_cpu_cycle_of
+ *   Returns the CPU cycle during which a device with the given divider runs
+ *   the given cycle.
+ *
+ * sys_sync
+ *   Runs the PPU and the APU up to the current CPU cycle.
+ *
+ * sys_sync_io
+ *   Mapper callback, synchronises before a register access and forces the
+ *   next cycle to run in lockstep, as the access may change the deadline.
+ *
+ * sys_update_deadline
+ *   Reschedules the PPU event and recomputes the deadline after a
+ *   synchronisation.
+ *
+ * sys_schedule
+ *   Runs the CPU for the given number of cycles. Returns true if the CPU
+ *   trapped.
+ *
+ * sys_run_until
+ *   Runs the system up to the given CPU cycle and synchronises all devices.
+ *   Returns true if the system stopped.
+ */
+static uint64_t sys_cycles_before(sys_t* sys, uint64_t cpu_cycle,
+                                  uint32_t divider) {
+  return cpu_cycle * sys->timing.cpu_divider / divider;
+}
+
+static uint64_t sys_master_time(uint64_t cycle, uint32_t divider) {
+  return (cycle + 1) * divider - 1;
+}
+
+static uint64_t sys_cpu_cycle_of(sys_t* sys, uint64_t cycle,
+                                 uint32_t divider) {
+  return sys_master_time(cycle, divider) / sys->timing.cpu_divider;
+}
+
+static void sys_sync(sys_t* sys) {
+  uint64_t ppu_cycles =
+      sys_cycles_before(sys, sys->cycles, sys->timing.ppu_divider);
+  uint64_t apu_cycles =
+      sys_cycles_before(sys, sys->cycles, sys->timing.apu_divider);
+  if (ppu_cycles == sys->ppu_cycles && apu_cycles == sys->apu_cycles) {
+    return;
+  }
+
+  PROFILER_POINT(sys->profiler, SYS_CPU)
+
+  ppu_run(sys->ppu, ppu_cycles - sys->ppu_cycles);
+  sys->ppu_cycles = ppu_cycles;
+
+  PROFILER_POINT(sys->profiler, SYS_PPU_LOGIC)
+
+  apu_run(sys->apu, apu_cycles - sys->apu_cycles, sys->audio_context,
+          sys->enqueue_audio, sys->get_queue_size);
+  sys->apu_cycles = apu_cycles;
+}
+
+static void sys_sync_io(void* context) {
+  sys_t* sys = context;
+  sys_sync(sys);
+  sys->deadline = sys->cycles;
+}
+
+static void sys_update_deadline(sys_t* sys) {
+  // A change in the PPU output is seen by the CPU in the next cycle
+  uint64_t nmi = sys->ppu_cycles + ppu_nmi_deadline(sys->ppu) - 1;
+  event_schedule(sys->events, EV_PPU_NMI,
+                 sys_master_time(nmi, sys->timing.ppu_divider));
+  sys->deadline = event_next(sys->events) / sys->timing.cpu_divider;
+}
+
+static bool sys_schedule(sys_t* sys, uint64_t cycles) {
+  cpu_t* cpu = sys->cpu;
+  uint64_t target = sys->cycles + cycles;
+  while (sys->cycles < target) {
+    // Until the deadline, the NMI output cannot have changed since the PPU
+    // was last synchronised
+    cpu_nmi(cpu, sys->ppu->nmi);
+
+    if (sys->cycles >= sys->deadline) {
+      bool trapped = cpu_cycle(cpu);
+      sys->cycles++;
+      sys_sync(sys);
+      sys_update_deadline(sys);
+      if (trapped) {
         return true;
       }
+    } else if (cpu_run(cpu, &sys->cycles, target, &sys->deadline)) {
+      return true;
+    }
+  }
+  return false;
+}
 
-      PROFILER_POINT(SYS_CPU)
+static bool sys_run_until(sys_t* sys, uint64_t cycle) {
+  bool trapped = sys_schedule(sys, cycle - sys->cycles);
+  sys_sync(sys);
+  sys_update_deadline(sys);
 
-      ppu_cycle(sys->ppu);
-      ppu_cycle(sys->ppu);
-      ppu_cycle(sys->ppu);
+  // Keep the master clock from falling behind, e.g. after sys_run_frame
+  uint64_t clock = sys->cycles * sys->timing.cpu_divider;
+  if (sys->clock < clock) {
+    sys->clock = clock;
+    sys->clock_remainder = 0;
+  }
 
-      PROFILER_POINT(SYS_PPU_LOGIC)
+  if (trapped) {
+    switch (sys->cpu->status) {
+      case CS_UNSUPPORTED_INSTRUCTION:
+        sys->status = SS_CPU_UNSUPPORTED_INSTRUCTION;
+        break;
+      default:
+        break;
+    }
+    sys->running = false;
+  }
+  return trapped;
+}
 
-      apu_cycle(sys->apu, context, enqueue_audio, get_queue_size);
+bool sys_run(sys_t* sys, uint32_t ms, void* context,
+             apu_enqueue_audio_t enqueue_audio,
+             apu_get_queue_size_t get_queue_size) {
+  if (sys->running) {
+    PROFILER_POINT(sys->profiler, SYS_START)
 
-      // PROFILER_POINT(SYS_APU)
+    sys_audio(sys, context, enqueue_audio, get_queue_size);
 
-      sys->clock -= CLOCK_PERIOD;
+    // Advance the master clock, keeping the remainder of the conversion
+    uint64_t scaled = ms * sys->timing.master_hz_numerator +
+                      sys->clock_remainder;
+    uint64_t divisor = 1000 * sys->timing.master_hz_denominator;
+    sys->clock += scaled / divisor;
+    sys->clock_remainder = scaled % divisor;
+
+    if (sys_run_until(sys, sys->clock / sys->timing.cpu_divider)) {
+      return true;
     }
 
-    PROFILER_POINT(SYS_END)
+    PROFILER_POINT(sys->profiler, SYS_END)
 
     if (sys->ppu->flip) {
       controller_clear(sys->controller);
       for (int i = 0; i < NUM_CONTROLLER_DRIVERS; i++) {
-        (*CONTROLLER_DRIVERS[i].poll)(sys->controller);
+        (*CONTROLLER_DRIVERS[i].poll)(sys->controller->drivers[i],
+                                      sys->controller);
       }
 
       if (sys->controller->pressed1.select && sys->controller->pressed1.start) {
@@ -116,9 +252,44 @@ bool sys_run(sys_t* sys, uint32_t ms, void* context,
   return false;
 }
 
+void sys_audio(sys_t* sys, void* context, apu_enqueue_audio_t enqueue_audio,
+               apu_get_queue_size_t get_queue_size) {
+  sys->audio_context = context;
+  sys->enqueue_audio = enqueue_audio;
+  sys->get_queue_size = get_queue_size;
+}
+
+bool sys_run_cycles(sys_t* sys, uint64_t cycles) {
+  if (!sys->running) {
+    return false;
+  }
+  return sys_run_until(sys, sys->cycles + cycles);
+}
+
+bool sys_run_frame(sys_t* sys) {
+  if (!sys->running) {
+    return false;
+  }
+
+  // The deadline is exact unless the frame is one cycle longer than assumed,
+  // in which case the next deadline is the following cycle
+  uint64_t frames = sys->ppu->frames;
+  while (sys->ppu->frames == frames) {
+    uint64_t cycle = sys_cpu_cycle_of(
+        sys, sys->ppu_cycles + ppu_vblank_deadline(sys->ppu) - 1,
+        sys->timing.ppu_divider);
+    if (sys_run_until(sys, cycle + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 static void sys_reset(sys_t* sys) { cpu_reset(sys->cpu); }
 
 sys_status_t sys_rom(sys_t* sys, char* path) {
+  // Decoded code refers to the memory of the previous ROM
+  cpu_jit_flush(sys->cpu);
   if (sys->mapper != NULL) {
     rom_destroy(sys->mapper);
     sys->mapper = NULL;
@@ -149,6 +320,8 @@ sys_status_t sys_rom(sys_t* sys, char* path) {
     sys->mapper->ppu = sys->ppu;
     sys->mapper->apu = sys->apu;
     sys->mapper->controller = sys->controller;
+    sys->mapper->sync = &sys_sync_io;
+    sys->mapper->sync_context = sys;
     sys_reset(sys);
   }
   return sys->status;
@@ -190,11 +363,17 @@ void sys_test(sys_t* sys) {
 }
 
 void sys_deinit(sys_t* sys) {
+  if (sys->mapper != NULL) {
+    rom_destroy(sys->mapper);
+  }
   for (int i = 0; i < NUM_CONTROLLER_DRIVERS; i++) {
-    (*CONTROLLER_DRIVERS[i].deinit)();
+    (*CONTROLLER_DRIVERS[i].deinit)(sys->controller->drivers[i]);
   }
   controller_deinit(sys->controller);
+  profiler_deinit(sys->profiler);
   ppu_deinit(sys->ppu);
+  apu_deinit(sys->apu);
+  event_deinit(sys->events);
   cpu_deinit(sys->cpu);
   free(sys);
 }